@@ -19,9 +19,11 @@
 #include "benchmark.h"
 #include "numa.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 namespace {
@@ -509,4 +511,67 @@ BenchmarkSetup setup_benchmark(std::istream& is) {
     return setup;
 }
 
-}  // namespace Hypnos
\ No newline at end of file
+// Reads a perft suite from an EPD file, one position per line followed by its
+// expected leaf counts, as in
+//
+// rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 ;D1 20 ;D2 400 ;D3 8902
+//
+// Counts deeper than maxDepth are dropped, unless maxDepth is 0. Positions
+// given in Shredder-FEN, with castling rights as rook files, are read as
+// Chess960 positions even when isChess960 is false.
+std::vector<PerftCase>
+setup_perft_suite(const std::string& epdFile, int maxDepth, bool isChess960) {
+
+    std::vector<PerftCase> suite;
+    std::ifstream          file(epdFile);
+    std::string            line;
+
+    if (!file.is_open())
+    {
+        std::cerr << "Unable to open file " << epdFile << std::endl;
+        return suite;
+    }
+
+    while (getline(file, line))
+    {
+        size_t sep = line.find(';');
+
+        if (sep == std::string::npos)
+            continue;
+
+        PerftCase          pc;
+        std::istringstream fields(line.substr(0, sep));
+        std::string        token, castling;
+
+        for (int i = 0; fields >> token; ++i)
+        {
+            pc.fen += (i ? " " : "") + token;
+            castling = i == 2 ? token : castling;
+        }
+
+        pc.isChess960 = isChess960 || std::any_of(castling.begin(), castling.end(), [](char c) {
+                            return c != 'K' && c != 'Q' && c != 'k' && c != 'q' && c != '-';
+                        });
+
+        for (; sep != std::string::npos; sep = line.find(';', sep + 1))
+        {
+            std::istringstream annotation(line.substr(sep + 1));
+            uint64_t           count;
+
+            if (!(annotation >> token >> count) || token[0] != 'D')
+                continue;
+
+            int depth = std::atoi(token.c_str() + 1);
+
+            if (depth > 0 && (!maxDepth || depth <= maxDepth))
+                pc.expected.emplace_back(depth, count);
+        }
+
+        if (!pc.expected.empty())
+            suite.push_back(pc);
+    }
+
+    return suite;
+}
+
+}  // namespace Hypnos
@@ -19,8 +19,10 @@
 #ifndef BENCHMARK_H_INCLUDED
 #define BENCHMARK_H_INCLUDED
 
+#include <cstdint>
 #include <iosfwd>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace Hypnos::Benchmark {
@@ -37,6 +39,17 @@ struct BenchmarkSetup {
 
 BenchmarkSetup setup_benchmark(std::istream&);
 
+// A position of a perft suite, with the leaf counts expected at each depth
+// and, once the suite has been run, the counts actually found.
+struct PerftCase {
+    std::string                           fen;
+    bool                                  isChess960;
+    std::vector<std::pair<int, uint64_t>> expected;
+    std::vector<uint64_t>                 counted;
+};
+
+std::vector<PerftCase> setup_perft_suite(const std::string&, int, bool);
+
 }  // namespace Hypnos
 
 #endif  // #ifndef BENCHMARK_H_INCLUDED
@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <cassert>
 #include <deque>
+#include <iomanip>
 #include <iosfwd>
 #include <memory>
 #include <ostream>
@@ -92,6 +93,37 @@ Engine::Engine(std::optional<std::string> path) :
           return std::nullopt;
       }));
 
+    options.add("Preserve Hash", Option(false));
+
+    options.add(  //
+      "Hash Placement",
+      Option("system var system var interleave var partition", "system", [this](const Option&) {
+          set_tt_size(options["Hash"]);
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "Huge Pages", Option("off var off var hash var all", "off", [this](const Option& o) {
+          set_huge_pages(o);
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "Hash Node Share", Option(0, 0, 50, [this](const Option&) {
+          set_tt_size(options["Hash"]);
+          return std::nullopt;
+      }));
+
+    options.add(  //
+      "HashSharedName", Option("", [this](const Option&) {
+          set_tt_size(options["Hash"]);
+          return std::nullopt;
+      }));
+
+    options.add("Eval Cache", Option(0, 0, 256));
+
+    options.add("Perft Hash", Option(16, 1, MaxHashMB));
+
     options.add(  //
       "Clear Hash", Option([this](const Option&) {
           search_clear();
@@ -101,9 +133,23 @@ Engine::Engine(std::optional<std::string> path) :
     options.add(  //
       "Ponder", Option(false));
 
+    options.add("SMP Diversity", Option(0, 0, 7));
+
+    options.add("Defer Busy Moves", Option(false));
+
+    options.add("Deterministic SMP", Option(false));
+
     options.add(  //
       "MultiPV", Option(1, 1, MAX_MOVES));
 
+    options.add("MultiPV Split", Option(false));
+
+    options.add("Split Root Moves", Option(false));
+
+    options.add("Reuse Root Moves", Option(false));
+
+    options.add("Ponder Candidates", Option(1, 1, 8));
+
     options.add("Skill Level", Option(20, 0, 20));
 
     options.add("MoveOverhead", Option(10, 0, 5000));
@@ -180,6 +226,7 @@ Engine::Engine(std::optional<std::string> path) :
                 case 3: Eval::style = Eval::Positional; break;
                 default: Eval::style = Eval::Default;   break;
             }
+            Eval::update_evaluator();
 
             const char* styleNames[] = { "HypnoS Default", "Aggressive", "Defensive", "Positional" };
             sync_cout << "info string Style set to: " << styleNames[value] << sync_endl;
@@ -206,6 +253,7 @@ Engine::Engine(std::optional<std::string> path) :
     // Add UCI option: Dynamic Strategy
     Option dynOption(false, [](const Option& o) -> std::optional<std::string> {
         Eval::useDynamicStrategy = bool(o);
+        Eval::update_evaluator();
         sync_cout << "info string Dynamic Strategy set to: "
                   << (Eval::useDynamicStrategy ? "true" : "false") << sync_endl;
         return std::nullopt;
@@ -213,6 +261,7 @@ Engine::Engine(std::optional<std::string> path) :
 
     // Force initialization at startup
     Eval::useDynamicStrategy = false;
+    Eval::update_evaluator();
 
     // Register the option
     options.add("Dynamic Strategy", dynOption);
@@ -220,12 +269,14 @@ Engine::Engine(std::optional<std::string> path) :
     options.add(  //
       "Materialistic Evaluation Strategy", Option(0, -12, 12, [](const Option& o) {
           Eval::MaterialisticEvaluationStrategy = 10 * int(o);
+          Eval::update_evaluator();
           return std::nullopt;
       }));
 
     options.add(  //
       "Positional Evaluation Strategy", Option(0, -12, 12, [](const Option& o) {
           Eval::PositionalEvaluationStrategy = 10 * int(o);
+          Eval::update_evaluator();
           return std::nullopt;
       }));
 
@@ -236,22 +287,41 @@ Engine::Engine(std::optional<std::string> path) :
 std::uint64_t Engine::perft(const std::string& fen, Depth depth, bool isChess960) {
     verify_networks();
 
-    return Benchmark::perft(fen, depth, isChess960);
+    return Benchmark::perft(fen, depth, isChess960, threads, size_t(options["Perft Hash"]));
+}
+
+std::uint64_t Engine::perft_suite(std::vector<Benchmark::PerftCase>& suite) {
+    verify_networks();
+
+    return Benchmark::perft_suite(suite, threads, size_t(options["Perft Hash"]));
 }
 
 void Engine::go(Search::LimitsType& limits) {
     assert(limits.perft == 0);
     verify_networks();
 
+    // The search can not race with the zeroing, clusters not reached yet are
+    // reset as the search probes them instead. A deterministic search waits for
+    // the zeroing to complete, so that the table it starts from never depends
+    // on how far the clear got.
+    if (options["Deterministic SMP"])
+        tt.finish_clearing();
+    else
+        tt.stop_clearing();
     threads.start_thinking(options, pos, states, limits);
 }
-void Engine::stop() { threads.stop = true; }
+void Engine::stop() {
+    threads.stop = true;
+    threads.notify_waiting();
+}
 
 void Engine::search_clear() {
     wait_for_search_finished();
 
-    tt.clear(threads);
+    // Clearing the workers waits for the pool threads, so it must come before
+    // the TT clear that keeps them busy in the background.
     threads.clear();
+    tt.clear(threads);
 
     // @TODO wont work with multiple instances
     Tablebases::init(options["SyzygyPath"]);  // Free mapped files
@@ -299,6 +369,10 @@ void Engine::set_position(const std::string& fen, const std::vector<std::string>
 // modifiers
 
 void Engine::set_numa_config_from_option(const std::string& o) {
+    // The new config reallocates the node tables of the TT, which the threads
+    // may still be clearing
+    tt.stop_clearing();
+
     if (o == "auto" || o == "system")
     {
         numaContext.set_numa_config(NumaConfig::from_system());
@@ -324,6 +398,7 @@ void Engine::set_numa_config_from_option(const std::string& o) {
 
 void Engine::resize_threads() {
     threads.wait_for_search_finished();
+    tt.stop_clearing();
     threads.set(numaContext.get_numa_config(), {options, threads, tt, networks}, updateContext);
 
     // Reallocate the hash with the new threadpool size
@@ -333,10 +408,63 @@ void Engine::resize_threads() {
 
 void Engine::set_tt_size(size_t mb) {
     wait_for_search_finished();
-    tt.resize(mb, threads);
+    const Option& placement = options["Hash Placement"];
+    const size_t  nodeMb    = mb * int(options["Hash Node Share"]) / 100;
+
+    tt.resize(mb - nodeMb, threads, options["Preserve Hash"], options["HashSharedName"],
+              placement == "interleave" ? TTPlacement::Interleave
+              : placement == "partition" ? TTPlacement::Partition
+                                         : TTPlacement::System,
+              options["Huge Pages"] != "off");
+    tt.resize_node_tables(numaContext, nodeMb);
 }
 
-void Engine::set_ponderhit(bool b) { threads.main_manager()->ponder = b; }
+// Explicit huge pages are used for the TT with "hash", and for the feature
+// transformers of the networks too with "all". Transparent huge pages are
+// used otherwise, or if explicit ones are not available.
+void Engine::set_huge_pages(const Option& mode) {
+    wait_for_search_finished();
+
+    if (large_page_objects_hugetlb() != (mode == "all"))
+    {
+        set_large_page_objects_hugetlb(mode == "all");
+
+        // Copies reallocate the network weights according to the new setting.
+        // The weights are the same, so the accumulator caches stay valid.
+        networks.modify_and_replicate([](NN::Networks& networks_) {
+            networks_ =
+              NN::Networks(NN::NetworkBig(networks_.big), NN::NetworkSmall(networks_.small));
+        });
+        threads.ensure_network_replicated();
+    }
+
+    set_tt_size(options["Hash"]);
+}
+
+void Engine::save_tt(const std::string& file) {
+    wait_for_search_finished();
+
+    bool saved = tt.save(file);
+    sync_cout << (saved ? "Hash saved successfully to " + file : "Failed to save hash to " + file)
+              << sync_endl;
+}
+
+void Engine::load_tt(const std::string& file) {
+    wait_for_search_finished();
+
+    bool loaded = tt.load(file, threads);
+    sync_cout << (loaded ? "Hash loaded successfully from " + file
+                         : "Failed to load hash from " + file)
+              << sync_endl;
+}
+
+void Engine::set_ponderhit(bool b) {
+    if (!b)
+        threads.main_manager()->ponder_outcome(true, 0);
+
+    threads.main_manager()->ponder = b;
+    threads.notify_waiting();
+}
 
 // network related
 
@@ -402,6 +530,10 @@ std::string Engine::visualize() const {
 
 int Engine::get_hashfull(int maxAge) const { return tt.hashfull(maxAge); }
 
+Eval::EvalStats Engine::get_eval_stats() const { return threads.eval_stats(); }
+
+TTStats Engine::get_tt_stats() const { return threads.tt_stats(); }
+
 std::vector<std::pair<size_t, size_t>> Engine::get_bound_thread_count_by_numa_node() const {
     auto                                   counts = threads.get_bound_thread_count_by_numa_node();
     const NumaConfig&                      cfg    = numaContext.get_numa_config();
@@ -458,4 +590,138 @@ std::string Engine::thread_allocation_information_as_string() const {
 
     return ss.str();
 }
+
+std::string Engine::tt_stats_information_as_string() const {
+    std::stringstream ss;
+
+    if (!TTStatsEnabled)
+        return "TT statistics are not available, build with ttstats=yes";
+
+    TTStats stats = threads.tt_stats();
+    auto    pct   = [](uint64_t n, uint64_t total) {
+        return 100.0 * n / std::max<uint64_t>(total, 1);
+    };
+
+    ss << std::fixed << std::setprecision(2)                                           //
+       << "TT probes: " << stats.probes << ", hits " << pct(stats.hits, stats.probes)  //
+       << "%, false matches " << pct(stats.falseMatches, stats.hits) << "% of hits"
+       << "\nTT replacements: by age " << stats.ageReplacements << ", by depth "
+       << stats.depthReplacements << ", depth decrements " << stats.depthDecrements
+       << ", first writes " << stats.firstWrites
+       << "\nTT cluster fill:";
+
+    auto     fill     = tt.fill_distribution();
+    uint64_t clusters = 0;
+    for (uint64_t n : fill)
+        clusters += n;
+
+    for (size_t i = 0; i < fill.size(); ++i)
+        ss << " " << i << ": " << pct(fill[i], clusters) << "%";
+
+    return ss.str();
+}
+
+// Ponder hit rate, once the outcome of a ponder search is known and only once
+// for each outcome, nothing otherwise.
+std::optional<std::string> Engine::ponder_stats_information_as_string() {
+    auto& stats = threads.main_manager()->ponderStats;
+
+    if (!stats.updated)
+        return std::nullopt;
+
+    stats.updated = false;
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << "Ponder hits " << stats.hits << "/"
+       << stats.searches << " (" << 100.0 * stats.hits / stats.searches
+       << "%), other pondered replies played " << stats.candidateHits << " ("
+       << 100.0 * stats.candidateHits / stats.searches << "%)";
+
+    return ss.str();
+}
+
+std::string Engine::tree_stats_information_as_string() const {
+    std::stringstream ss;
+
+    if (!Search::TreeStatsEnabled)
+        return "Search statistics are not available, build with stats=yes";
+
+    Search::TreeStats stats = threads.tree_stats();
+    auto              pct   = [](uint64_t n, uint64_t total) {
+        return 100.0 * n / std::max<uint64_t>(total, 1);
+    };
+
+    uint64_t nodes = stats.pvNodes + stats.nonPvNodes + stats.qsearchNodes;
+
+    ss << std::fixed << std::setprecision(2)                                           //
+       << "Search nodes: PV " << stats.pvNodes << " (" << pct(stats.pvNodes, nodes)    //
+       << "%), non-PV " << stats.nonPvNodes << " (" << pct(stats.nonPvNodes, nodes)  //
+       << "%), qsearch " << stats.qsearchNodes << " (" << pct(stats.qsearchNodes, nodes) << "%)"
+       << "\nCutoffs: " << stats.cutoffs << ", by the first move "
+       << pct(stats.firstMoveCutoffs, stats.cutoffs) << "%, TT cutoffs "
+       << pct(stats.ttCutoffs, stats.nonPvNodes) << "% of non-PV nodes"
+       << "\nNull move: " << stats.nullMoveTries << " tries, "
+       << pct(stats.nullMoveCutoffs, stats.nullMoveTries) << "% fail high"
+       << "\nLMR: " << stats.lmrSearches << " reduced searches, "
+       << pct(stats.lmrResearches, stats.lmrSearches) << "% re-searched"
+       << "\nProbCut: " << stats.probCutTries << " tries, "
+       << pct(stats.probCutCutoffs, stats.probCutTries) << "% cutoffs"
+       << "\nBranching factor by depth:";
+
+    for (int d = 1; d < Search::TreeStats::MaxDepth; ++d)
+        if (stats.loopNodes[d])
+            ss << " " << d << ": " << double(stats.loopMoves[d]) / stats.loopNodes[d];
+
+    return ss.str();
+}
+
+std::string Engine::large_pages_information_as_string() const {
+    return "TT " + tt.large_pages_info() + ", big net " + networks->big.large_pages_info()
+         + ", small net " + networks->small.large_pages_info();
+}
+
+// Reports on which NUMA nodes the TT pages are, and which fraction of TT
+// accesses would go to another node than the one of the accessing thread,
+// assuming accesses are evenly spread over the table as hashing makes them.
+std::string Engine::tt_placement_information_as_string() {
+    wait_for_search_finished();
+
+    std::vector<int> threadNodes(threads.size());
+
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads.run_on_thread(i, [&threadNodes, i]() { threadNodes[i] = current_numa_node(); });
+
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads.wait_on_thread(i);
+
+    std::vector<int>    pageNodes = tt.page_nodes(4096);
+    std::vector<size_t> pagesByNode;
+    size_t              known = 0, remote = 0;
+
+    for (int n : pageNodes)
+        if (n >= 0)
+        {
+            pagesByNode.resize(std::max(pagesByNode.size(), size_t(n) + 1));
+            ++pagesByNode[n];
+            ++known;
+
+            for (int t : threadNodes)
+                remote += t != n;
+        }
+
+    std::stringstream ss;
+    ss << "TT placement: " << std::string(options["Hash Placement"]) << ", pages by node:";
+
+    if (!known || std::count(threadNodes.begin(), threadNodes.end(), -1))
+        return ss.str() + " unknown";
+
+    ss << std::fixed << std::setprecision(2);
+
+    for (size_t n = 0; n < pagesByNode.size(); ++n)
+        ss << " " << n << ": " << 100.0 * pagesByNode[n] / known << "%";
+
+    ss << "\nRemote TT accesses: " << 100.0 * remote / (known * threadNodes.size()) << "%";
+
+    return ss.str();
+}
 }
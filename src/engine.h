@@ -28,6 +28,7 @@
 #include <utility>
 #include <vector>
 
+#include "benchmark.h"
 #include "nnue/network.h"
 #include "numa.h"
 #include "position.h"
@@ -62,6 +63,7 @@ class Engine {
     ~Engine() { wait_for_search_finished(); }
 
     std::uint64_t perft(const std::string& fen, Depth depth, bool isChess960);
+    std::uint64_t perft_suite(std::vector<Benchmark::PerftCase>& suite);
 
     // non blocking call to start searching
     void go(Search::LimitsType&);
@@ -78,6 +80,9 @@ class Engine {
     void set_numa_config_from_option(const std::string& o);
     void resize_threads();
     void set_tt_size(size_t mb);
+    void set_huge_pages(const Option& mode);
+    void save_tt(const std::string& file);
+    void load_tt(const std::string& file);
     void set_ponderhit(bool);
     void search_clear();
 
@@ -104,6 +109,9 @@ class Engine {
 
     int get_hashfull(int maxAge = 0) const;
 
+    Eval::EvalStats get_eval_stats() const;
+    TTStats         get_tt_stats() const;
+
     std::string                            fen() const;
     void                                   flip();
     std::string                            visualize() const;
@@ -112,6 +120,11 @@ class Engine {
     std::string                            numa_config_information_as_string() const;
     std::string                            thread_allocation_information_as_string() const;
     std::string                            thread_binding_information_as_string() const;
+    std::string                            tt_stats_information_as_string() const;
+    std::string                            tree_stats_information_as_string() const;
+    std::optional<std::string>             ponder_stats_information_as_string();
+    std::string                            tt_placement_information_as_string();
+    std::string                            large_pages_information_as_string() const;
 
    private:
     const std::string binaryDirectory;
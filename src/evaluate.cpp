@@ -28,6 +28,7 @@
 #include <sstream>
 #include <tuple>
 
+#include "bitboard.h"
 #include "nnue/network.h"
 #include "nnue/nnue_misc.h"
 #include "position.h"
@@ -45,71 +46,88 @@ bool      useDynamicStrategy              = false;
 bool      explorationMode                 = false;
 EvalStyle style                           = Default;
 
+namespace {
+
+// Squares within king distance 2 of s, i.e. the 5x5 box centered on s
+Bitboard near_square_bb(Square s) {
+    Bitboard b = square_bb(s);
+    b |= shift<EAST>(b) | shift<WEST>(b);
+    b |= shift<EAST>(b) | shift<WEST>(b);
+    b |= shift<NORTH>(b) | shift<SOUTH>(b);
+    b |= shift<NORTH>(b) | shift<SOUTH>(b);
+    return b;
+}
+
+// Pawns of the given set that have no friendly pawn on an adjacent file
+Bitboard isolated_pawns(Bitboard pawns) {
+    Bitboard files = pawns;
+    files |= files << 8, files |= files << 16, files |= files << 32;
+    files |= files >> 8, files |= files >> 16, files |= files >> 32;
+    return pawns & ~(shift<EAST>(files) | shift<WEST>(files));
+}
+
+}  // namespace
+
 // Aggressive style: bonus for knights near the enemy king
 int calculate_aggressiveness_bonus(const Position& pos) {
-    int bonus = 0;
-    for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-        if (pos.piece_on(s) == make_piece(pos.side_to_move(), KNIGHT) &&
-            pos.is_near_enemy_king(s)) {
-            bonus += 20;  // Bonus
-        }
-    }
-    return bonus;
+    Color us = pos.side_to_move();
+    return 20 * popcount(pos.pieces(us, KNIGHT) & near_square_bb(pos.square<KING>(~us)));
 }
 
 // Defensive style: penalty for isolated pawns and bonus for castling
 int calculate_defensiveness_bonus(const Position& pos) {
-    int penalty = 0;
-    Bitboard pawns = pos.pieces(pos.side_to_move(), PAWN);
-    for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-        if (pos.piece_on(s) == make_piece(pos.side_to_move(), PAWN) &&
-            pos.is_isolated(s, pawns)) {
-            penalty -= 15;  // Penalità pedoni isolati
-        }
-    }
-    if (pos.can_castle(CastlingRights(CastlingRights::KING_SIDE | CastlingRights::QUEEN_SIDE))) {
+    int penalty = -15 * popcount(isolated_pawns(pos.pieces(pos.side_to_move(), PAWN)));
+
+    if (pos.can_castle(CastlingRights(CastlingRights::KING_SIDE | CastlingRights::QUEEN_SIDE)))
         penalty += 40;  // Bonus arrocco
-    }
+
     return penalty;
 }
 
 // Positional style: bonus for bishop pairs and rooks on the seventh rank
 int calculate_positional_bonus(const Position& pos) {
-    int bonus = 0;
-    for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-        if (pos.piece_on(s) == make_piece(pos.side_to_move(), BISHOP)) {
-            bonus += 10;  // Bonus for the bishop pair
-        }
-        if (pos.piece_on(s) == make_piece(pos.side_to_move(), ROOK) &&
-            pos.is_on_seventh_rank(s, pos.side_to_move())) {
-            bonus += 15;  // Bonus for rooks on the seventh rank
-        }
-    }
-    return bonus;
+    Color us = pos.side_to_move();
+    return 10 * pos.count<BISHOP>(us)
+         + 15 * popcount(pos.pieces(us, ROOK) & rank_bb(relative_rank(us, RANK_7)));
 }
 
 // Hypnos default style: favors central control and early development
 int calculate_hypnos_default_bonus(const Position& pos) {
-    int bonus = 0;
+    Color us = pos.side_to_move();
 
-    for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-        Piece pc = pos.piece_on(s);
-        if (pc == NO_PIECE || color_of(pc) != pos.side_to_move())
-            continue;
+    // Bonus for early minor piece development
+    int bonus = 10 * popcount(pos.pieces(us, KNIGHT, BISHOP) & ~rank_bb(relative_rank(us, RANK_1)));
 
-        // Bonus for early minor piece development
-        if ((type_of(pc) == KNIGHT || type_of(pc) == BISHOP) &&
-            rank_of(s) != (pos.side_to_move() == WHITE ? RANK_1 : RANK_8))
-            bonus += 10;
-
-        // Bonus for pawns controlling center (D/E file)
-        if (type_of(pc) == PAWN && (file_of(s) == FILE_D || file_of(s) == FILE_E))
-            bonus += 5;
-    }
+    // Bonus for pawns controlling center (D/E file)
+    bonus += 5 * popcount(pos.pieces(us, PAWN) & (FileDBB | FileEBB));
 
     return bonus;
 }
 
+namespace {
+
+// Sums the terms of the selected style. Some terms are intentionally counted
+// twice, matching the weights the styles were tuned with.
+template<EvalStyle Style>
+int style_bonus(const Position& pos) {
+    Color us = pos.side_to_move();
+
+    if constexpr (Style == Aggressive)
+    {
+        Bitboard advanced = us == WHITE ? Rank5BB | Rank6BB | Rank7BB : Rank4BB | Rank3BB | Rank2BB;
+        return 2 * calculate_aggressiveness_bonus(pos)
+             + 10 * popcount(pos.pieces(us, PAWN) & advanced);
+    }
+    else if constexpr (Style == Defensive)
+        return -calculate_aggressiveness_bonus(pos) + 2 * calculate_defensiveness_bonus(pos);
+    else if constexpr (Style == Positional)
+        return 2 * calculate_positional_bonus(pos);
+    else
+        return calculate_hypnos_default_bonus(pos);
+}
+
+}  // namespace
+
 // Returns a static, purely materialistic evaluation of the position
 int simple_eval(const Position& pos) {
     Color c = pos.side_to_move();
@@ -119,91 +137,152 @@ int simple_eval(const Position& pos) {
 
 bool use_smallnet(const Position& pos) { return std::abs(simple_eval(pos)) > 962; }
 
-// Main evaluation function
-Value evaluate(const Eval::NNUE::Networks&    networks,
-               const Position&                pos,
-               Eval::NNUE::AccumulatorStack&  accumulators,
-               Eval::NNUE::AccumulatorCaches& caches,
-               int                            optimism) {
-
-    assert(!pos.checkers());
+namespace {
 
-    bool smallNet           = use_smallnet(pos);
-    auto [psqt, positional] = smallNet ? networks.small.evaluate(pos, accumulators, &caches.small)
-                                       : networks.big.evaluate(pos, accumulators, &caches.big);
+// Network part of the evaluation, specialized on the evaluation settings so
+// that the default configuration does not pay for the optional terms. It only
+// depends on the position and the settings, so it can be cached.
+template<EvalStyle Style, bool DynamicStrategy, bool CustomWeights>
+EvalCache::Entry network_evaluate(const Eval::NNUE::Networks&    networks,
+                                  const Position&                pos,
+                                  Eval::NNUE::AccumulatorStack&  accumulators,
+                                  Eval::NNUE::AccumulatorCaches& caches,
+                                  EvalStats&                     stats) {
 
     int materialWeight   = 125;
     int positionalWeight = 131;
 
-    if (useDynamicStrategy)
+    if constexpr (DynamicStrategy)
     {
         int totalPhase = 24;
-        int phase = totalPhase;
-
-        phase -= 1 * (pos.count<KNIGHT>(WHITE) + pos.count<KNIGHT>(BLACK));
-        phase -= 1 * (pos.count<BISHOP>(WHITE) + pos.count<BISHOP>(BLACK));
-        phase -= 2 * (pos.count<ROOK>(WHITE)   + pos.count<ROOK>(BLACK));
-        phase -= 4 * (pos.count<QUEEN>(WHITE)  + pos.count<QUEEN>(BLACK));
-
-        phase = std::clamp(phase, 0, totalPhase);
+        int phase      = std::clamp(totalPhase - pos.game_phase(), 0, totalPhase);
 
         materialWeight   -= (totalPhase - phase);
         positionalWeight += (totalPhase - phase);
     }
 
-    materialWeight   += MaterialisticEvaluationStrategy;
-    positionalWeight += PositionalEvaluationStrategy;
-
-    Value nnue = (materialWeight * psqt + positionalWeight * positional) / 128;
-
-    // Evaluation adjustment based on style
-    if (style == Aggressive) {
-        nnue += calculate_aggressiveness_bonus(pos);
-        for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-            if (pos.piece_on(s) == make_piece(pos.side_to_move(), KNIGHT) && pos.is_near_enemy_king(s)) {
-                nnue += 20;
-            }
-            if (pos.piece_on(s) == make_piece(pos.side_to_move(), PAWN) &&
-                relative_rank(pos.side_to_move(), s) >= RANK_5) {
-                nnue += 10;
-            }
-        }
-    } else if (style == Defensive) {
-        nnue -= calculate_aggressiveness_bonus(pos);
-        nnue += calculate_defensiveness_bonus(pos);
-        Bitboard pawnSet = pos.pieces(pos.side_to_move(), PAWN);
-        for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-            if (pos.piece_on(s) == make_piece(pos.side_to_move(), PAWN) && pos.is_isolated(s, pawnSet)) {
-                nnue -= 15;
-            }
-        }
-        if (pos.can_castle(CastlingRights(CastlingRights::KING_SIDE | CastlingRights::QUEEN_SIDE))) {
-            nnue += 40;
-        }
-    } else if (style == Positional) {
-        nnue += calculate_positional_bonus(pos);
-        for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-            if (pos.piece_on(s) == make_piece(pos.side_to_move(), BISHOP)) {
-                nnue += 10;
-            }
-            if (pos.piece_on(s) == make_piece(pos.side_to_move(), ROOK) &&
-                pos.is_on_seventh_rank(s, pos.side_to_move())) {
-                nnue += 15;
-            }
+    if constexpr (CustomWeights)
+    {
+        materialWeight += MaterialisticEvaluationStrategy;
+        positionalWeight += PositionalEvaluationStrategy;
+    }
+
+    // Evaluation adjustment based on style, independent of the network used
+    int styleBonus = style_bonus<Style>(pos);
+
+    bool smallNet           = use_smallnet(pos);
+    auto [psqt, positional] = smallNet ? networks.small.evaluate(pos, accumulators, &caches.small)
+                                       : networks.big.evaluate(pos, accumulators, &caches.big);
+
+    Value nnue = (materialWeight * psqt + positionalWeight * positional) / 128 + styleBonus;
+
+    // Re-evaluate with the big net if the small net's verdict is not clear enough
+    if (smallNet)
+    {
+        ++stats.smallNet;
+
+        if (std::abs(nnue) < 236)
+        {
+            ++stats.fallbacks;
+            std::tie(psqt, positional) = networks.big.evaluate(pos, accumulators, &caches.big);
+            nnue = (materialWeight * psqt + positionalWeight * positional) / 128 + styleBonus;
         }
-    } else if (style == Default) {
-        nnue += calculate_hypnos_default_bonus(pos);
     }
 
-    if (smallNet && (std::abs(nnue) < 236)) {
-        std::tie(psqt, positional) = networks.big.evaluate(pos, accumulators, &caches.big);
-        nnue                       = (materialWeight * psqt + positionalWeight * positional) / 128;
-        smallNet                   = false;
+    return {0, int32_t(nnue), int32_t(std::abs(psqt - positional))};
+}
+
+using NetworkEvaluator = EvalCache::Entry (*)(const Eval::NNUE::Networks&,
+                                              const Position&,
+                                              Eval::NNUE::AccumulatorStack&,
+                                              Eval::NNUE::AccumulatorCaches&,
+                                              EvalStats&);
+
+template<EvalStyle Style>
+NetworkEvaluator select_evaluator(bool dynamicStrategy, bool customWeights) {
+    return dynamicStrategy ? customWeights ? network_evaluate<Style, true, true>
+                                           : network_evaluate<Style, true, false>
+         : customWeights   ? network_evaluate<Style, false, true>
+                           : network_evaluate<Style, false, false>;
+}
+
+NetworkEvaluator evaluator = network_evaluate<Default, false, false>;
+
+// Mixed into the position key when probing the evaluation cache, so that
+// entries computed with different settings never match.
+Key configKey = 0;
+
+}  // namespace
+
+// Selects the specialization of the evaluation matching the current settings.
+// Must be called whenever one of them changes, and never during a search.
+void update_evaluator() {
+    bool customWeights = MaterialisticEvaluationStrategy || PositionalEvaluationStrategy;
+
+    switch (style)
+    {
+    case Aggressive :
+        evaluator = select_evaluator<Aggressive>(useDynamicStrategy, customWeights);
+        break;
+    case Defensive :
+        evaluator = select_evaluator<Defensive>(useDynamicStrategy, customWeights);
+        break;
+    case Positional :
+        evaluator = select_evaluator<Positional>(useDynamicStrategy, customWeights);
+        break;
+    default :
+        evaluator = select_evaluator<Default>(useDynamicStrategy, customWeights);
+    }
+
+    configKey = (uint64_t(style) << 48 | uint64_t(useDynamicStrategy) << 32
+                 | uint64_t(uint16_t(MaterialisticEvaluationStrategy)) << 16
+                 | uint64_t(uint16_t(PositionalEvaluationStrategy)))
+              * 0x9E3779B97F4A7C15ULL;
+}
+
+void EvalCache::resize(size_t mbSize) {
+
+    size_t newSize = mbSize * 1024 * 1024 / sizeof(Entry);
+
+    if (newSize != table.size())
+        table = std::vector<Entry>(newSize);
+}
+
+void EvalCache::clear() { std::fill(table.begin(), table.end(), Entry()); }
+
+// Main evaluation function. The network part is taken from the evaluation
+// cache when possible, the optimism and rule50 scaling are always applied.
+Value evaluate(const Eval::NNUE::Networks&    networks,
+               const Position&                pos,
+               Eval::NNUE::AccumulatorStack&  accumulators,
+               Eval::NNUE::AccumulatorCaches& caches,
+               EvalCache&                     evalCache,
+               int                            optimism,
+               EvalStats&                     stats) {
+
+    assert(!pos.checkers());
+
+    Key               key = pos.key() ^ configKey;
+    EvalCache::Entry* tte = evalCache.probe(key);
+    EvalCache::Entry  e;
+
+    if (tte && tte->key == key)
+    {
+        ++stats.cacheHits;
+        e = *tte;
+    }
+    else
+    {
+        ++stats.cacheMisses;
+        e = evaluator(networks, pos, accumulators, caches, stats);
+
+        if (tte)
+            *tte = {key, e.nnue, e.nnueComplexity};
     }
 
-    int nnueComplexity = std::abs(psqt - positional);
-    optimism += optimism * nnueComplexity / 468;
-    nnue -= nnue * nnueComplexity / 18000;
+    Value nnue = e.nnue;
+    optimism += optimism * e.nnueComplexity / 468;
+    nnue -= nnue * e.nnueComplexity / 18000;
 
     int material = 535 * pos.count<PAWN>() + pos.non_pawn_material();
     int v        = (nnue * (77777 + material) + optimism * (7777 + material)) / 77777;
@@ -221,6 +300,8 @@ std::string trace(Position& pos, const NNUE::Networks& networks) {
         return "Final evaluation: none (in check)";
 
     Eval::NNUE::AccumulatorStack accumulators;
+    EvalCache                    evalCache;
+    EvalStats                    stats;
     auto                         caches = std::make_unique<Eval::NNUE::AccumulatorCaches>(networks);
 
     std::stringstream ss;
@@ -234,7 +315,7 @@ std::string trace(Position& pos, const NNUE::Networks& networks) {
     v                       = pos.side_to_move() == WHITE ? v : -v;
     ss << "NNUE evaluation        " << 0.01 * UCIEngine::to_cp(v, pos) << " (white side)\n";
 
-    v = evaluate(networks, pos, accumulators, *caches, VALUE_ZERO);
+    v = evaluate(networks, pos, accumulators, *caches, evalCache, VALUE_ZERO, stats);
     v = pos.side_to_move() == WHITE ? v : -v;
     ss << "Final evaluation       " << 0.01 * UCIEngine::to_cp(v, pos) << " (white side)";
     ss << " [with scaled NNUE, ...]";
@@ -19,7 +19,12 @@
 #ifndef EVALUATE_H_INCLUDED
 #define EVALUATE_H_INCLUDED
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
+
+#include "misc.h"
 
 #include "types.h"
 
@@ -48,6 +53,47 @@ struct AccumulatorCaches;
 class AccumulatorStack;
 }
 
+// Per-thread evaluation counters. smallNet and fallbacks count how often the
+// small net is tried and how often its result is not decisive enough so that
+// the big net has to be evaluated too, which helps tuning the thresholds of
+// use_smallnet() and of the fallback in evaluate().
+struct EvalStats {
+    uint64_t smallNet    = 0;
+    uint64_t fallbacks   = 0;
+    uint64_t cacheHits   = 0;
+    uint64_t cacheMisses = 0;
+
+    EvalStats& operator+=(const EvalStats& other) {
+        smallNet += other.smallNet;
+        fallbacks += other.fallbacks;
+        cacheHits += other.cacheHits;
+        cacheMisses += other.cacheMisses;
+        return *this;
+    }
+};
+
+// EvalCache is a small per-thread direct-mapped table storing the network part
+// of the evaluation, so that positions reached again through transpositions or
+// re-searches do not need to touch the accumulators. A table of size zero
+// disables the cache.
+class EvalCache {
+   public:
+    struct Entry {
+        Key     key;
+        int32_t nnue;
+        int32_t nnueComplexity;
+    };
+
+    void   resize(size_t mbSize);
+    void   clear();
+    Entry* probe(Key key) {
+        return table.empty() ? nullptr : &table[mul_hi64(key, table.size())];
+    }
+
+   private:
+    std::vector<Entry> table;
+};
+
 std::string trace(Position& pos, const Eval::NNUE::Networks& networks);
 
 int   simple_eval(const Position& pos);
@@ -56,7 +102,10 @@ Value evaluate(const NNUE::Networks&          networks,
                const Position&                pos,
                Eval::NNUE::AccumulatorStack&  accumulators,
                Eval::NNUE::AccumulatorCaches& caches,
-               int                            optimism);
+               EvalCache&                     evalCache,
+               int                            optimism,
+               EvalStats&                     stats);
+void  update_evaluator();
 
 // Evaluation tuning and dynamic strategy
 extern int  MaterialisticEvaluationStrategy;
@@ -18,7 +18,12 @@
 
 #include "memory.h"
 
+#include <atomic>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
 
 #if __has_include("features.h")
     #include <features.h>
@@ -26,6 +31,16 @@
 
 #if defined(__linux__) && !defined(__ANDROID__)
     #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#if (defined(__linux__) && !defined(__ANDROID__)) || defined(__APPLE__)
+    #define USE_SHARED_MEMORY
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) \
@@ -66,6 +81,22 @@ using AdjustTokenPrivileges_t =
 
 namespace Hypnos {
 
+// Blocks from aligned_large_pages_alloc() known to be backed by large pages,
+// with their size and page size. On Linux these are the hugetlbfs mappings,
+// which must be unmapped instead of freed.
+struct LargePageBlock {
+    size_t size, pageSize;
+};
+
+static std::mutex                            largePageBlocksMutex;
+static std::map<const void*, LargePageBlock> largePageBlocks;
+
+static std::atomic<bool> largePageObjectsHugeTLB{false};
+
+void set_large_page_objects_hugetlb(bool enabled) { largePageObjectsHugeTLB = enabled; }
+
+bool large_page_objects_hugetlb() { return largePageObjectsHugeTLB; }
+
 // Wrappers for systems where the c++17 implementation does not guarantee the
 // availability of aligned_alloc(). Memory allocated with std_aligned_alloc()
 // must be freed with std_aligned_free().
@@ -179,11 +210,17 @@ static void* aligned_large_pages_alloc_windows([[maybe_unused]] size_t allocSize
     #endif
 }
 
-void* aligned_large_pages_alloc(size_t allocSize) {
+void* aligned_large_pages_alloc(size_t allocSize, bool) {
 
     // Try to allocate large pages
     void* mem = aligned_large_pages_alloc_windows(allocSize);
 
+    if (mem)
+    {
+        std::lock_guard<std::mutex> lock(largePageBlocksMutex);
+        largePageBlocks[mem] = {allocSize, GetLargePageMinimum()};
+    }
+
     // Fall back to regular, page-aligned, allocation if necessary
     if (!mem)
         mem = VirtualAlloc(nullptr, allocSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
@@ -193,7 +230,52 @@ void* aligned_large_pages_alloc(size_t allocSize) {
 
 #else
 
-void* aligned_large_pages_alloc(size_t allocSize) {
+    #if defined(__linux__) && defined(MAP_HUGETLB)
+
+// Maps explicit huge pages, 1 GB ones first, skipping a page size when rounding
+// up would waste more than 1/8 of the memory. These come from the pool reserved
+// by the administrator (vm.nr_hugepages, or hugepages= at boot), so they do not
+// depend on the fragmentation of memory like transparent huge pages do.
+static void* hugetlb_alloc(size_t allocSize) {
+
+    for (int shift : {30, 21})
+    {
+        const size_t pageSize = size_t(1) << shift;
+        const size_t size     = (allocSize + pageSize - 1) / pageSize * pageSize;
+
+        if (size - allocSize > allocSize / 8)
+            continue;
+
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+        #if defined(MAP_HUGE_SHIFT)
+        flags |= shift << MAP_HUGE_SHIFT;
+        #else
+        if (shift != 21)  // Only the default huge page size, assumed to be 2 MB
+            continue;
+        #endif
+
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+        if (mem != MAP_FAILED)
+        {
+            std::lock_guard<std::mutex> lock(largePageBlocksMutex);
+            largePageBlocks[mem] = {size, pageSize};
+            return mem;
+        }
+    }
+
+    return nullptr;
+}
+
+    #endif
+
+void* aligned_large_pages_alloc(size_t allocSize, [[maybe_unused]] bool hugeTLB) {
+
+    #if defined(__linux__) && defined(MAP_HUGETLB)
+    if (hugeTLB)
+        if (void* mem = hugetlb_alloc(allocSize))
+            return mem;
+    #endif
 
     #if defined(__linux__)
     constexpr size_t alignment = 2 * 1024 * 1024;  // 2MB page size assumed
@@ -212,6 +294,10 @@ void* aligned_large_pages_alloc(size_t allocSize) {
 
 #endif
 
+void* aligned_large_pages_alloc(size_t allocSize) {
+    return aligned_large_pages_alloc(allocSize, false);
+}
+
 bool has_large_pages() {
 
 #if defined(_WIN32)
@@ -251,6 +337,11 @@ bool has_large_pages() {
 
 void aligned_large_pages_free(void* mem) {
 
+    {
+        std::lock_guard<std::mutex> lock(largePageBlocksMutex);
+        largePageBlocks.erase(mem);
+    }
+
     if (mem && !VirtualFree(mem, 0, MEM_RELEASE))
     {
         DWORD err = GetLastError();
@@ -262,7 +353,188 @@ void aligned_large_pages_free(void* mem) {
 
 #else
 
-void aligned_large_pages_free(void* mem) { std_aligned_free(mem); }
+void aligned_large_pages_free(void* mem) {
+
+    {
+        std::lock_guard<std::mutex> lock(largePageBlocksMutex);
+        auto                        it = largePageBlocks.find(mem);
+
+        if (it != largePageBlocks.end())
+        {
+            munmap(mem, it->second.size);
+            largePageBlocks.erase(it);
+            return;
+        }
+    }
+
+    std_aligned_free(mem);
+}
+
+#endif
+
+
+static std::string page_size_string(size_t pageSize) {
+    return pageSize >= (1 << 30) ? std::to_string(pageSize >> 30) + " GB"
+         : pageSize >= (1 << 20) ? std::to_string(pageSize >> 20) + " MB"
+                                 : std::to_string(pageSize >> 10) + " KB";
+}
+
+// Reports the page size of a block from aligned_large_pages_alloc(). On Linux,
+// memory not from hugetlbfs is looked up in /proc/self/smaps to find how much of
+// its mapping is backed by transparent huge pages, which is only known once
+// the memory has been touched.
+std::string large_pages_info(const void* mem) {
+
+    if (!mem)
+        return "none";
+
+    {
+        std::lock_guard<std::mutex> lock(largePageBlocksMutex);
+        auto                        it = largePageBlocks.find(mem);
+
+        if (it != largePageBlocks.end())
+            return page_size_string(it->second.pageSize);
+    }
+
+#if defined(__linux__)
+
+    std::ifstream      smaps("/proc/self/smaps");
+    std::string        line;
+    bool               found = false;
+    unsigned long long start, end, rssKb = 0, hugeKb = 0;
+
+    while (std::getline(smaps, line))
+    {
+        // Mappings start with a line like "7f1c2a000000-7f1c2c000000 rw-p ..."
+        if (std::sscanf(line.c_str(), "%llx-%llx", &start, &end) == 2)
+        {
+            if (found)
+                break;
+
+            found = start <= uintptr_t(mem) && uintptr_t(mem) < end;
+        }
+        else if (found)
+        {
+            std::sscanf(line.c_str(), "Rss: %llu kB", &rssKb);
+            std::sscanf(line.c_str(), "AnonHugePages: %llu kB", &hugeKb);
+        }
+    }
+
+    if (hugeKb)
+        return "2 MB transparent (" + std::to_string(100 * hugeKb / std::max(rssKb, hugeKb))
+             + "%)";
+
+    return "4 KB";
+
+#else
+
+    return "default";
+
+#endif
+}
+
+
+// Shared memory segments are POSIX shm objects, which stay around when the
+// last process detaches so that later processes can reuse their content.
+
+#if defined(USE_SHARED_MEMORY)
+
+void* shared_memory_attach(const std::string& name, size_t& size, bool& created) {
+
+    const std::string path = name[0] == '/' ? name : "/" + name;
+
+    int fd  = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    created = fd != -1;
+
+    if (created)
+    {
+        if (ftruncate(fd, off_t(size)))
+        {
+            close(fd);
+            shm_unlink(path.c_str());
+            return nullptr;
+        }
+    }
+    else
+    {
+        struct stat st;
+
+        fd = shm_open(path.c_str(), O_RDWR, 0600);
+
+        if (fd == -1)
+            return nullptr;
+
+        if (fstat(fd, &st) || st.st_size <= 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        size = size_t(st.st_size);
+    }
+
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mem == MAP_FAILED)
+        return nullptr;
+
+    #if defined(MADV_HUGEPAGE)
+    madvise(mem, size, MADV_HUGEPAGE);
+    #endif
+
+    return mem;
+}
+
+void shared_memory_detach(void* mem, size_t size) {
+    if (mem)
+        munmap(mem, size);
+}
+
+#else
+
+void* shared_memory_attach(const std::string&, size_t&, bool&) { return nullptr; }
+
+void shared_memory_detach(void*, size_t) {}
 
 #endif
+
+
+// The NUMA queries go through raw syscalls, as libnuma may not be installed
+
+#if defined(__linux__) && !defined(__ANDROID__) && defined(SYS_move_pages) && defined(SYS_getcpu)
+
+std::vector<int> memory_page_nodes(const std::vector<const void*>& addresses) {
+
+    std::vector<void*> pages;
+    std::vector<int>   status(addresses.size(), -1);
+
+    for (const void* a : addresses)
+        pages.push_back(const_cast<void*>(a));
+
+    // Without target nodes, move_pages() only reports where the pages are
+    if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0))
+        return std::vector<int>(addresses.size(), -1);
+
+    for (int& s : status)
+        s = std::max(s, -1);  // Negative errno for pages not present
+
+    return status;
+}
+
+int current_numa_node() {
+    unsigned cpu, node;
+    return syscall(SYS_getcpu, &cpu, &node, nullptr) ? -1 : int(node);
+}
+
+#else
+
+std::vector<int> memory_page_nodes(const std::vector<const void*>& addresses) {
+    return std::vector<int>(addresses.size(), -1);
+}
+
+int current_numa_node() { return -1; }
+
+#endif
+
 }  // namespace Hypnos
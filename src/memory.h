@@ -24,8 +24,10 @@
 #include <cstdint>
 #include <memory>
 #include <new>
+#include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "types.h"
 
@@ -34,12 +36,35 @@ namespace Hypnos {
 void* std_aligned_alloc(size_t alignment, size_t size);
 void  std_aligned_free(void* ptr);
 
-// Memory aligned by page size, min alignment: 4096 bytes
+// Memory aligned by page size, min alignment: 4096 bytes. With hugeTLB, explicit
+// 1 GB and then 2 MB huge pages are tried first, on Linux only.
 void* aligned_large_pages_alloc(size_t size);
+void* aligned_large_pages_alloc(size_t size, bool hugeTLB);
 void  aligned_large_pages_free(void* mem);
 
 bool has_large_pages();
 
+// Size of the pages backing memory from aligned_large_pages_alloc(), as text
+std::string large_pages_info(const void* mem);
+
+// Whether make_unique_large_page() uses explicit huge pages, off by default
+void set_large_page_objects_hugetlb(bool enabled);
+bool large_page_objects_hugetlb();
+
+// Maps the named shared memory segment, creating it with the given size if it
+// does not exist yet, in which case created is set. Otherwise size is set to
+// the size of the existing segment. Returns nullptr on failure or if shared
+// memory is not supported.
+void* shared_memory_attach(const std::string& name, size_t& size, bool& created);
+void  shared_memory_detach(void* mem, size_t size);
+
+// NUMA node of the memory page holding each of the given addresses, -1 where
+// unknown, e.g. for pages not backed yet. Only supported on Linux.
+std::vector<int> memory_page_nodes(const std::vector<const void*>& addresses);
+
+// NUMA node the calling thread is running on, -1 if unknown
+int current_numa_node();
+
 // Frees memory which was placed there with placement new.
 // Works for both single objects and arrays of unknown bound.
 template<typename T, typename FREE_FUNC>
@@ -138,7 +163,10 @@ std::enable_if_t<!std::is_array_v<T>, LargePagePtr<T>> make_unique_large_page(Ar
     static_assert(alignof(T) <= 4096,
                   "aligned_large_pages_alloc() may fail for such a big alignment requirement of T");
 
-    T* obj = memory_allocator<T>(aligned_large_pages_alloc, std::forward<Args>(args)...);
+    const auto func = [](size_t size) {
+        return aligned_large_pages_alloc(size, large_page_objects_hugetlb());
+    };
+    T* obj = memory_allocator<T>(func, std::forward<Args>(args)...);
 
     return LargePagePtr<T>(obj);
 }
@@ -151,7 +179,10 @@ std::enable_if_t<std::is_array_v<T>, LargePagePtr<T>> make_unique_large_page(siz
     static_assert(alignof(ElementType) <= 4096,
                   "aligned_large_pages_alloc() may fail for such a big alignment requirement of T");
 
-    ElementType* memory = memory_allocator<T>(aligned_large_pages_alloc, num);
+    const auto func = [](size_t size) {
+        return aligned_large_pages_alloc(size, large_page_objects_hugetlb());
+    };
+    ElementType* memory = memory_allocator<T>(func, num);
 
     return LargePagePtr<T>(memory);
 }
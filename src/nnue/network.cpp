@@ -339,6 +339,12 @@ void Network<Arch, Transformer>::load_internal() {
 }
 
 
+template<typename Arch, typename Transformer>
+std::string Network<Arch, Transformer>::large_pages_info() const {
+    return Hypnos::large_pages_info(featureTransformer.get());
+}
+
+
 template<typename Arch, typename Transformer>
 void Network<Arch, Transformer>::initialize() {
     featureTransformer = make_unique_large_page<Transformer>();
@@ -19,48 +19,202 @@
 #ifndef PERFT_H_INCLUDED
 #define PERFT_H_INCLUDED
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include "benchmark.h"
+#include "memory.h"
+#include "misc.h"
 #include "movegen.h"
 #include "position.h"
+#include "thread.h"
 #include "types.h"
 #include "uci.h"
 
 namespace Hypnos::Benchmark {
 
-// Utility to verify move generation. All the leaf nodes up
-// to the given depth are generated and counted, and the sum is returned.
-template<bool Root>
-uint64_t perft(Position& pos, Depth depth) {
+// Lockless hash table of perft counts, shared by the threads of a perft run
+// and keyed by position key and depth. Each entry holds the count and a check
+// word, the key and depth xored with the count, so that an entry torn by two
+// threads writing at once fails the check instead of giving a wrong count. It
+// has its own size, set by the "Perft Hash" option, so that perft does not add
+// a second table of the TT size on top of the live TT.
+class PerftTable {
+   public:
+    PerftTable(size_t mbSize, ThreadPool& threads) :
+        count(std::max<size_t>(mbSize * 1024 * 1024 / sizeof(Entry), 1)),
+        entries(static_cast<Entry*>(aligned_large_pages_alloc(count * sizeof(Entry)))) {
 
-    StateInfo st;
+        if (!entries)
+        {
+            std::cerr << "Failed to allocate " << mbSize << "MB for perft hash." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // Each thread zeroes its part of the table
+        const size_t threadCount = threads.num_threads();
+
+        for (size_t i = 0; i < threadCount; ++i)
+            threads.run_on_thread(i, [this, i, threadCount]() {
+                const size_t start = count * i / threadCount;
+                const size_t end   = count * (i + 1) / threadCount;
+
+                std::memset(static_cast<void*>(&entries[start]), 0, (end - start) * sizeof(Entry));
+            });
+
+        for (size_t i = 0; i < threadCount; ++i)
+            threads.wait_on_thread(i);
+    }
+
+    PerftTable(const PerftTable&)            = delete;
+    PerftTable& operator=(const PerftTable&) = delete;
+    ~PerftTable() { aligned_large_pages_free(entries); }
+
+    bool probe(Key key, Depth depth, uint64_t& nodes) const {
+        const Entry& e = entries[mul_hi64(key, count)];
+        nodes          = e.nodes.load(std::memory_order_relaxed);
+        return (e.check.load(std::memory_order_relaxed) ^ nodes) == check_word(key, depth);
+    }
+
+    void store(Key key, Depth depth, uint64_t nodes) {
+        Entry& e = entries[mul_hi64(key, count)];
+        e.nodes.store(nodes, std::memory_order_relaxed);
+        e.check.store(check_word(key, depth) ^ nodes, std::memory_order_relaxed);
+    }
+
+   private:
+    struct Entry {
+        std::atomic<uint64_t> check, nodes;
+    };
+
+    static Key check_word(Key key, Depth depth) {
+        return key ^ (uint64_t(depth) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    size_t count;
+    Entry* entries;
+};
+
+// Utility to verify move generation. All the leaf nodes up to the given depth
+// are generated and counted, and the sum is returned. Subtrees of depth 2 and
+// more are looked up in the hash table first.
+inline uint64_t perft(Position& pos, Depth depth, PerftTable& table) {
 
-    uint64_t   cnt, nodes = 0;
-    const bool leaf = (depth == 2);
+    if (depth <= 1)
+        return MoveList<LEGAL>(pos).size();
+
+    uint64_t nodes;
+    if (table.probe(pos.key(), depth, nodes))
+        return nodes;
+
+    StateInfo st;
+    nodes = 0;
 
     for (const auto& m : MoveList<LEGAL>(pos))
     {
-        if (Root && depth <= 1)
-            cnt = 1, nodes++;
-        else
-        {
-            pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
-            nodes += cnt;
-            pos.undo_move(m);
-        }
-        if (Root)
-            sync_cout << UCIEngine::move(m, pos.is_chess960()) << ": " << cnt << sync_endl;
+        pos.do_move(m, st);
+        nodes += perft(pos, depth - 1, table);
+        pos.undo_move(m);
     }
+
+    table.store(pos.key(), depth, nodes);
     return nodes;
 }
 
-inline uint64_t perft(const std::string& fen, Depth depth, bool isChess960) {
+// Splits the root moves over the threads of the pool, each thread taking the
+// next move not yet counted, and prints the count of each move in the order
+// of the move generator once they are all done.
+inline uint64_t perft(const std::string& fen,
+                      Depth              depth,
+                      bool               isChess960,
+                      ThreadPool&        threads,
+                      size_t             hashMb) {
+
     StateListPtr states(new std::deque<StateInfo>(1));
     Position     p;
     p.set(fen, isChess960, &states->back());
 
-    return perft<true>(p, depth);
+    const MoveList<LEGAL> moves(p);
+    std::vector<uint64_t> counts(moves.size(), 1);
+
+    if (depth > 1)
+    {
+        PerftTable          table(hashMb, threads);
+        std::atomic<size_t> next{0};
+
+        for (size_t i = 0; i < threads.num_threads(); ++i)
+            threads.run_on_thread(i, [&]() {
+                StateInfo rootSt, st;
+                Position  pos;
+                pos.set(fen, isChess960, &rootSt);
+
+                for (size_t idx; (idx = next++) < moves.size();)
+                {
+                    pos.do_move(moves.begin()[idx], st);
+                    counts[idx] = perft(pos, depth - 1, table);
+                    pos.undo_move(moves.begin()[idx]);
+                }
+            });
+
+        for (size_t i = 0; i < threads.num_threads(); ++i)
+            threads.wait_on_thread(i);
+    }
+
+    uint64_t nodes = 0;
+
+    for (size_t i = 0; i < moves.size(); ++i)
+    {
+        nodes += counts[i];
+        sync_cout << UCIEngine::move(moves.begin()[i], isChess960) << ": " << counts[i]
+                  << sync_endl;
+    }
+
+    return nodes;
+}
+
+// Counts the positions of a perft suite at each of their annotated depths.
+// The threads of the pool share one hash table and each takes the next
+// position not yet counted, so a suite of many positions keeps them all busy.
+// The counts are stored in the suite and their sum is returned.
+inline uint64_t perft_suite(std::vector<PerftCase>& suite, ThreadPool& threads, size_t hashMb) {
+
+    PerftTable          table(hashMb, threads);
+    std::atomic<size_t> next{0};
+
+    for (size_t i = 0; i < threads.num_threads(); ++i)
+        threads.run_on_thread(i, [&]() {
+            for (size_t idx; (idx = next++) < suite.size();)
+            {
+                PerftCase& pc = suite[idx];
+                StateInfo  st;
+                Position   pos;
+                pos.set(pc.fen, pc.isChess960, &st);
+
+                pc.counted.clear();
+                for (const auto& [depth, expected] : pc.expected)
+                    pc.counted.push_back(perft(pos, Depth(depth), table));
+            }
+        });
+
+    for (size_t i = 0; i < threads.num_threads(); ++i)
+        threads.wait_on_thread(i);
+
+    uint64_t nodes = 0;
+
+    for (const PerftCase& pc : suite)
+        for (uint64_t count : pc.counted)
+            nodes += count;
+
+    return nodes;
 }
 }
 
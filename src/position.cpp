@@ -340,6 +340,7 @@ void Position::set_state() const {
     st->nonPawnKey[WHITE] = st->nonPawnKey[BLACK] = 0;
     st->pawnKey                                   = Zobrist::noPawns;
     st->nonPawnMaterial[WHITE] = st->nonPawnMaterial[BLACK] = VALUE_ZERO;
+    st->gamePhase                                           = 0;
     st->checkersBB = attackers_to(square<KING>(sideToMove)) & pieces(~sideToMove);
 
     set_check_info();
@@ -360,6 +361,7 @@ void Position::set_state() const {
             if (type_of(pc) != KING)
             {
                 st->nonPawnMaterial[color_of(pc)] += PieceValue[pc];
+                st->gamePhase += PhaseWeight[pc];
 
                 if (type_of(pc) <= BISHOP)
                     st->minorPieceKey ^= Zobrist::psq[pc][s];
@@ -704,6 +706,42 @@ bool Position::gives_check(Move m) const {
 }
 
 
+// Computes the hash key of the position after the given move, without doing it.
+// Only normal moves are handled, callers must skip promotions, castling and en
+// passant captures.
+Key Position::key_after(Move m) const {
+
+    assert(m.type_of() == NORMAL);
+
+    Color  us       = sideToMove;
+    Square from     = m.from_sq();
+    Square to       = m.to_sq();
+    Piece  pc       = piece_on(from);
+    Piece  captured = piece_on(to);
+    Key    k        = st->key ^ Zobrist::side;
+
+    if (st->epSquare != SQ_NONE)
+        k ^= Zobrist::enpassant[file_of(st->epSquare)];
+
+    if (captured)
+        k ^= Zobrist::psq[captured][to];
+
+    k ^= Zobrist::psq[pc][to] ^ Zobrist::psq[pc][from];
+
+    if (st->castlingRights && (castlingRightsMask[from] | castlingRightsMask[to]))
+        k ^= Zobrist::castling[st->castlingRights]
+           ^ Zobrist::castling[st->castlingRights
+                               & ~(castlingRightsMask[from] | castlingRightsMask[to])];
+
+    // Same condition as in do_move() for setting the en passant square
+    if (type_of(pc) == PAWN && (int(to) ^ int(from)) == 16
+        && (attacks_bb<PAWN>(to - pawn_push(us), us) & pieces(~us, PAWN)))
+        k ^= Zobrist::enpassant[file_of(to - pawn_push(us))];
+
+    return (captured || type_of(pc) == PAWN) ? k : adjust_key50<true>(k);
+}
+
+
 // Makes a move, and saves all information necessary
 // to a StateInfo object. The move is assumed to be legal. Pseudo-legal
 // moves should be filtered out before this function is called.
@@ -785,6 +823,7 @@ DirtyPiece Position::do_move(Move                      m,
         else
         {
             st->nonPawnMaterial[them] -= PieceValue[captured];
+            st->gamePhase -= PhaseWeight[captured];
             st->nonPawnKey[them] ^= Zobrist::psq[captured][capsq];
 
             if (type_of(captured) <= BISHOP)
@@ -868,6 +907,7 @@ DirtyPiece Position::do_move(Move                      m,
 
             // Update material
             st->nonPawnMaterial[us] += PieceValue[promotion];
+            st->gamePhase += PhaseWeight[promotion];
         }
 
         // Update pawn hash key
@@ -1296,6 +1336,11 @@ bool Position::pos_is_ok() const {
         || (ep_square() != SQ_NONE && relative_rank(sideToMove, ep_square()) != RANK_6))
         assert(0 && "pos_is_ok: Default");
 
+    if (st->gamePhase
+        != PhaseWeight[W_KNIGHT] * count<KNIGHT>() + PhaseWeight[W_BISHOP] * count<BISHOP>()
+             + PhaseWeight[W_ROOK] * count<ROOK>() + PhaseWeight[W_QUEEN] * count<QUEEN>())
+        assert(0 && "pos_is_ok: Phase");
+
     if (Fast)
         return true;
 
@@ -47,6 +47,7 @@ struct StateInfo {
     int    castlingRights;
     int    rule50;
     int    pliesFromNull;
+    int    gamePhase;
     Square epSquare;
 
     // Not copied when making a move (will be recomputed anyhow)
@@ -149,6 +150,7 @@ class Position {
 
     // Accessing hash keys
     Key key() const;
+    Key key_after(Move m) const;
     Key material_key() const;
     Key pawn_key() const;
     Key minor_piece_key() const;
@@ -165,6 +167,7 @@ class Position {
     int   rule50_count() const;
     Value non_pawn_material(Color c) const;
     Value non_pawn_material() const;
+    int   game_phase() const;
 
     // Position consistency check, for debugging
     bool pos_is_ok() const;
@@ -315,6 +318,8 @@ inline Value Position::non_pawn_material() const {
     return non_pawn_material(WHITE) + non_pawn_material(BLACK);
 }
 
+inline int Position::game_phase() const { return st->gamePhase; }
+
 inline int Position::game_ply() const { return gamePly; }
 
 inline int Position::rule50_count() const { return st->rule50; }
@@ -28,6 +28,7 @@
 #include <cstdlib>
 #include <initializer_list>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <ratio>
 #include <string>
@@ -117,6 +118,28 @@ void update_correction_history(const Position& pos,
           << bonus * 141 / 128;
 }
 
+// Holds the BusyNodes slot of a node while its moves are searched, a null
+// table leaves the node unmarked.
+class BusyNodeMark {
+   public:
+    BusyNodeMark(BusyNodes* table, Key key, Depth depth, size_t threadIdx) :
+        nodes(table),
+        posKey(key),
+        owning(table && table->enter(key, depth, threadIdx)) {}
+
+    ~BusyNodeMark() {
+        if (owning)
+            nodes->leave(posKey);
+    }
+
+    bool active() const { return nodes != nullptr; }
+
+   private:
+    BusyNodes* nodes;
+    Key        posKey;
+    bool       owning;
+};
+
 // Add a small random component to draw evaluations to avoid 3-fold blindness
 Value value_draw(size_t nodes) { return VALUE_DRAW - 1 + Value(nodes & 0x2); }
 Value value_to_tt(Value v, int ply);
@@ -194,10 +217,53 @@ void Search::Worker::start_searching() {
 
     accumulatorStack.reset();
 
-    // Non-main threads go directly to iterative_deepening()
+    tt.bind_node_table(numaAccessToken);
+
+    if constexpr (TTStatsEnabled)
+        tt.bind_stats(&ttStats);
+
+    // In deterministic mode each thread searches its own share of the nodes, and
+    // holds back its TT writes until all the threads have finished the iteration.
+    deterministic       = options["Deterministic SMP"] && threads.size() > 1;
+    nodeBudget          = deterministic && limits.nodes
+                          ? std::max<uint64_t>(1, limits.nodes / threads.size())
+                          : 0;
+    nodeBudgetExhausted = false;
+
+    if (deterministic)
+    {
+        size_t mb = std::clamp<size_t>(size_t(options["Hash"]) / threads.size(), 1, 64);
+
+        if (!deferredWrites || deferredWrites->sizeMb != mb)
+            deferredWrites = std::make_unique<TTDeferredTable>(mb);
+        else
+            deferredWrites->clear();
+    }
+
+    tt.bind_deferred_table(deterministic ? deferredWrites.get() : nullptr);
+
+    // Only reallocated, and so emptied, when the "Eval Cache" size has changed
+    evalCache.resize(size_t(options["Eval Cache"]));
+
+    // Non-main threads go directly to iterative_deepening(). A thread pondering
+    // on another reply than the ponder move joins the search of the ponder move
+    // on a ponderhit, see ThreadPool::start_thinking().
     if (!is_mainthread())
     {
         iterative_deepening();
+
+        if (ponderSibling && !threads.stop)
+        {
+            ponderSibling = false;
+            rootPos.set(ponderRoot.fen, rootPos.is_chess960(), &rootState);
+            rootState = ponderRoot.state;
+            rootMoves = ponderRoot.rootMoves;
+            rootDepth = completedDepth = 0;
+            nmpMinPly                  = 0;
+
+            accumulatorStack.reset();
+            iterative_deepening();
+        }
         return;
     }
 
@@ -207,6 +273,8 @@ void Search::Worker::start_searching() {
 
     Move bookMove = Move::none();
 
+    threads.sharedPVLines.clear();
+
     if (rootMoves.empty())
     {
         rootMoves.emplace_back(Move::none());
@@ -241,43 +309,63 @@ if (bookMove == Move::none() && (bool) options["Book2"]
         {
             threads.start_searching();  // start non-main threads
             iterative_deepening();      // main thread start searching
+
+            // With "Split Root Moves" every group searches its move to the given depth
+            if (rootMoveSplit && limits.depth)
+                threads.wait_for_search_finished();
         }
     }
 
     // When we reach the maximum depth, we can arrive here without a raise of
     // threads.stop. However, if we are pondering or in an infinite search,
     // the UCI protocol states that we shouldn't print the best move before the
-    // GUI sends a "stop" or "ponderhit" command. We therefore simply wait here
-    // until the GUI sends one of those commands.
-    while (!threads.stop && (main_manager()->ponder || limits.infinite))
-    {}  // Busy wait for a stop or a ponder reset
+    // GUI sends a "stop" or "ponderhit" command. We therefore sleep here until
+    // the GUI sends one of those commands, see Engine::stop() and set_ponderhit().
+    threads.wait_until(
+      [&] { return threads.stop || !(main_manager()->ponder || limits.infinite); });
 
     // Stop the threads if not already stopped (also raise the stop if
-    // "ponderhit" just reset threads.ponder)
+    // "ponderhit" just reset threads.ponder), and release those waiting in
+    // sync_iteration() for this thread.
     threads.stop = true;
+    threads.notify_waiting();
 
     // Wait until all threads have finished
     threads.wait_for_search_finished();
 
+    tt.bind_deferred_table(nullptr);
+
     // When playing in 'nodes as time' mode, subtract the searched nodes from
     // the available ones before exiting.
     if (limits.npmsec)
         main_manager()->tm.advance_nodes_time(threads.nodes_searched()
                                               - limits.inc[rootPos.side_to_move()]);
 
+    // Take the best of the lines distributed over the threads
+    if (multiPVSplit && bookMove == Move::none() && !threads.sharedPVLines.empty())
+        threads.sharedPVLines.merge_into(rootMoves);
+
+    // Take the best of the root moves searched by the groups of threads
+    if (rootMoveSplit && bookMove == Move::none() && !threads.sharedPVLines.empty())
+    {
+        std::vector<Depth> depths;
+        rootMoves.clear();
+        threads.sharedPVLines.lines(rootMoves, depths);
+    }
+
     Worker* bestThread = this;
     Skill   skill =
       Skill(options["Skill Level"], options["UCI_LimitStrength"] ? int(options["UCI_Elo"]) : 0);
 
     if (int(options["MultiPV"]) == 1 && !limits.depth && !limits.mate && !skill.enabled()
-        && rootMoves[0].pv[0] != Move::none())
+        && !rootMoveSplit && rootMoves[0].pv[0] != Move::none())
         bestThread = threads.get_best_thread()->worker.get();
 
     main_manager()->bestPreviousScore        = bestThread->rootMoves[0].score;
     main_manager()->bestPreviousAverageScore = bestThread->rootMoves[0].averageScore;
 
-    // Send again PV info if we have a new best thread
-    if (bestThread != this)
+    // Send again PV info if we have a new best thread, or merged lines
+    if (bestThread != this || ((multiPVSplit || rootMoveSplit) && bookMove == Move::none()))
         main_manager()->pv(*bestThread, threads, tt, bestThread->completedDepth);
 
     std::string ponder;
@@ -286,6 +374,8 @@ if (bookMove == Move::none() && (bool) options["Book2"]
         || bestThread->rootMoves[0].extract_ponder_from_tt(tt, rootPos))
         ponder = UCIEngine::move(bestThread->rootMoves[0].pv[1], rootPos.is_chess960());
 
+    main_manager()->save_root(rootPos, bestThread->rootMoves);
+
     auto bestmove = UCIEngine::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
     main_manager()->updates.onBestmove(bestmove, ponder);
 }
@@ -336,9 +426,35 @@ void Search::Worker::iterative_deepening() {
             mainThread->iterValue.fill(mainThread->bestPreviousScore);
     }
 
+    // Helper threads are diversified according to the "SMP Diversity" option
+    diversity    = is_mainthread() ? 0 : int(options["SMP Diversity"]);
+    lmrOffset    = diversity & PerturbLMR ? (int((threadIdx - 1) % 5) - 2) * 192 : 0;
+    rootRotation = 0;
+
+    // Skipped iterations would unbalance the barriers of the deterministic mode
+    if (deterministic)
+        diversity &= ~SkipDepths;
+
+    deferBusyMoves = bool(options["Defer Busy Moves"]) && threads.size() > 1 && !deterministic;
+
     size_t multiPV = size_t(options["MultiPV"]);
     Skill skill(options["Skill Level"], options["UCI_LimitStrength"] ? int(options["UCI_Elo"]) : 0);
 
+    // With "Split Root Moves" an analysis of a few root moves gives each move its
+    // own group of threads. A thread keeps only the move of its group, so that it
+    // searches it with its own aspiration window, and shares its results through
+    // SharedPVLines. Skipped iterations would leave a group of one thread without
+    // some of the depths.
+    rootMoveSplit = options["Split Root Moves"] && rootMoves.size() > 1
+                 && rootMoves.size() <= threads.size() && !limits.use_time_management()
+                 && !skill.enabled() && !tbConfig.rootInTB && !deterministic;
+
+    if (rootMoveSplit)
+    {
+        rootMoves  = {rootMoves[threadIdx % rootMoves.size()]};
+        diversity &= ~SkipDepths;
+    }
+
     // When playing with strength handicap enable MultiPV search that we will
     // use behind-the-scenes to retrieve a set of possible moves.
     if (skill.enabled())
@@ -346,22 +462,49 @@ void Search::Worker::iterative_deepening() {
 
     multiPV = std::min(multiPV, rootMoves.size());
 
+    // With "MultiPV Split" each group of threads searches only some of the
+    // lines, and the threads share their results through SharedPVLines.
+    multiPVSplit = options["MultiPV Split"] && threads.size() > 1 && multiPV > 1
+                && !skill.enabled() && !tbConfig.rootInTB && !deterministic;
+    splitGroups = std::min(threads.size(), multiPV);
+
     int searchAgainCounter = 0;
 
     lowPlyHistory.fill(86);
 
     // Iterative deepening loop until requested to stop or the target depth is reached
     while (++rootDepth < MAX_PLY && !threads.stop
-           && !(limits.depth && mainThread && rootDepth > limits.depth))
+           && !(limits.depth && (mainThread || deterministic || rootMoveSplit)
+                && rootDepth > limits.depth))
     {
+        // Distribute search depths across the helper threads, so that they do
+        // not all search the same iteration at the same time
+        if (diversity & SkipDepths)
+        {
+            constexpr int SkipSize[]  = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+            constexpr int SkipPhase[] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+            size_t i = (threadIdx - 1) % std::size(SkipSize);
+            if (((rootDepth + SkipPhase[i]) / SkipSize[i]) % 2)
+                continue;
+        }
+
         // Age out PV variability metric
         if (mainThread)
             totBestMoveChanges /= 2;
 
+        // Take the best lines found so far by all the threads, so that the lines
+        // this thread excludes from its own ones are the same for everyone.
+        if (multiPVSplit)
+            threads.sharedPVLines.merge_into(rootMoves);
+
         // Save the last iteration's scores before the first PV line is searched and
         // all the move scores except the (new) PV are set to -VALUE_INFINITE.
+        // Until an iteration completes, there are no scores yet and root moves
+        // keep the previous scores carried over by SearchManager::reuse_root().
         for (RootMove& rm : rootMoves)
-            rm.previousScore = rm.score;
+            if (completedDepth || rm.score != -VALUE_INFINITE)
+                rm.previousScore = rm.score;
 
         size_t pvFirst = 0;
         pvLast         = 0;
@@ -380,9 +523,16 @@ void Search::Worker::iterative_deepening() {
                         break;
             }
 
+            if (multiPVSplit && pvIdx % splitGroups != threadIdx % splitGroups)
+                continue;
+
             // Reset UCI info selDepth for each depth and each PV line
             selDepth = 0;
 
+            // Search first one of the best three root moves, depending on thread and depth
+            if (diversity & RotateRootMoves)
+                rootRotation = (threadIdx + rootDepth) % std::min<size_t>(3, pvLast - pvIdx);
+
             // Reset aspiration window starting size
             delta     = 5 + std::abs(rootMoves[pvIdx].meanSquaredScore) / 11134;
             Value avg = rootMoves[pvIdx].averageScore;
@@ -417,14 +567,14 @@ void Search::Worker::iterative_deepening() {
                 // If search has been stopped, we break immediately. Sorting is
                 // safe because RootMoves is still valid, although it refers to
                 // the previous iteration.
-                if (threads.stop)
+                if (stopped())
                     break;
 
                 // When failing high/low give some update before a re-search. To avoid
                 // excessive output that could hang GUIs like Fritz 19, only start
                 // at nodes > 10M (rather than depth N, which can be reached quickly)
                 if (mainThread && multiPV == 1 && (bestValue <= alpha || bestValue >= beta)
-                    && nodes > 10000000)
+                    && nodes > 10000000 && !deterministic)
                     main_manager()->pv(*this, threads, tt, rootDepth);
 
                 // In case of failing low/high increase aspiration window and re-search,
@@ -451,11 +601,15 @@ void Search::Worker::iterative_deepening() {
                 assert(alpha >= -VALUE_INFINITE && beta <= VALUE_INFINITE);
             }
 
+            if ((multiPVSplit || rootMoveSplit) && !threads.stop)
+                threads.sharedPVLines.publish(rootMoves[pvIdx], rootDepth);
+
             // Sort the PV lines searched so far and update the GUI
             std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
 
-            if (mainThread
-                && (threads.stop || pvIdx + 1 == multiPV || nodes > 10000000)
+            if (mainThread && !deterministic
+                && (threads.stop || pvIdx + 1 == multiPV
+                    || (multiPVSplit && pvIdx + splitGroups >= multiPV) || nodes > 10000000)
                 // A thread that aborted search can have mated-in/TB-loss PV and
                 // score that cannot be trusted, i.e. it can be delayed or refuted
                 // if we would have had time to fully search other root-moves. Thus
@@ -464,16 +618,16 @@ void Search::Worker::iterative_deepening() {
                 && !(threads.abortedSearch && is_loss(rootMoves[0].uciScore)))
                 main_manager()->pv(*this, threads, tt, rootDepth);
 
-            if (threads.stop)
+            if (stopped())
                 break;
         }
 
-        if (!threads.stop)
+        if (!stopped())
             completedDepth = rootDepth;
 
         // We make sure not to pick an unproven mated-in score,
         // in case this thread prematurely stopped search (aborted-search).
-        if (threads.abortedSearch && rootMoves[0].score != -VALUE_INFINITE
+        if ((threads.abortedSearch || nodeBudgetExhausted) && rootMoves[0].score != -VALUE_INFINITE
             && is_loss(rootMoves[0].score))
         {
             // Bring the last best move to the front for best thread selection.
@@ -489,6 +643,9 @@ void Search::Worker::iterative_deepening() {
             lastBestMoveDepth = rootDepth;
         }
 
+        if (deterministic)
+            sync_iteration();
+
         if (!mainThread)
             continue;
 
@@ -576,6 +733,39 @@ void Search::Worker::iterative_deepening() {
 }
 
 
+// Whether this thread has to abandon its search, because all the threads are
+// stopped or because it has searched its share of the nodes.
+bool Search::Worker::stopped() const {
+    return threads.stop.load(std::memory_order_relaxed) || nodeBudgetExhausted
+        || (ponderSibling && !threads.main_manager()->ponder);
+}
+
+// Barrier at the end of each iteration of the deterministic mode. The last
+// thread to arrive writes the held back TT entries of all the threads, in
+// thread order, and stops the search once a thread has used up its nodes.
+// Every thread thus starts an iteration with the same TT, whatever the timing.
+// The iteration is reported from there too, while no thread is searching, so
+// that the node counts do not depend on the timing either.
+void Search::Worker::sync_iteration() {
+
+    threads.sync([&]() {
+        bool exhausted = false;
+
+        for (auto&& th : threads)
+        {
+            tt.apply_deferred(*th->worker->deferredWrites);
+            exhausted |= th->worker->nodeBudgetExhausted;
+        }
+
+        Worker& mainWorker = *threads.main_thread()->worker;
+        mainWorker.main_manager()->pv(mainWorker, threads, tt, rootDepth);
+
+        if (exhausted)
+            threads.stop = true;
+    });
+}
+
+
 void Search::Worker::do_move(Position& pos, const Move move, StateInfo& st) {
     do_move(pos, move, st, pos.gives_check(move));
 }
@@ -622,6 +812,11 @@ void Search::Worker::clear() {
         reductions[i] = int(2796 / 128.0 * std::log(i));
 
     refreshTable.clear(networks[numaAccessToken]);
+
+    evalCache.clear();
+    evalStats = {};
+    ttStats   = {};
+    treeStats = {};
 }
 
 
@@ -643,6 +838,9 @@ Value Search::Worker::search(
     // Limit the depth if extensions made it too large
     depth = std::min(depth, MAX_PLY - 1);
 
+    if constexpr (TreeStatsEnabled)
+        ++(PvNode ? treeStats.pvNodes : treeStats.nonPvNodes);
+
     // Check if we have an upcoming move that draws by repetition
     if (!rootNode && alpha < VALUE_DRAW && pos.upcoming_repetition(ss->ply))
     {
@@ -684,6 +882,9 @@ Value Search::Worker::search(
     if (is_mainthread())
         main_manager()->check_time(*thisThread);
 
+    if (nodeBudget && completedDepth >= 1 && nodes >= nodeBudget)
+        nodeBudgetExhausted = true;
+
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
     if (PvNode && thisThread->selDepth < ss->ply + 1)
         thisThread->selDepth = ss->ply + 1;
@@ -691,7 +892,7 @@ Value Search::Worker::search(
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
-        if (threads.stop.load(std::memory_order_relaxed) || pos.is_draw(ss->ply)
+        if (stopped() || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
             return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos)
                                                         : value_draw(thisThread->nodes);
@@ -724,13 +925,17 @@ Value Search::Worker::search(
     auto [ttHit, ttData, ttWriter] = tt.probe(posKey);
     // Need further processing of the saved data
     ss->ttHit    = ttHit;
-    ttData.move  = rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
+    ttData.move  = rootNode ? thisThread->rootMoves[thisThread->pvIdx + thisThread->rootRotation].pv[0]
                  : ttHit    ? ttData.move
                             : Move::none();
     ttData.value = ttHit ? value_from_tt(ttData.value, ss->ply, pos.rule50_count()) : VALUE_NONE;
     ss->ttPv     = excludedMove ? ss->ttPv : PvNode || (ttHit && ttData.is_pv);
     ttCapture    = ttData.move && pos.capture_stage(ttData.move);
 
+    if constexpr (TTStatsEnabled)
+        if (ttHit && !rootNode && ttData.move && !pos.pseudo_legal(ttData.move))
+            ++thisThread->ttStats.falseMatches;
+
     // At this point, if excluded, skip straight to step 6, static eval. However,
     // to save indentation, we list the condition in all code between here and there.
 
@@ -757,6 +962,8 @@ Value Search::Worker::search(
         // For high rule50 counts don't produce transposition table cutoffs.
         if (pos.rule50_count() < 90)
         {
+            bool cutoff = true;
+
             if (depth >= 8 && ttData.move && pos.pseudo_legal(ttData.move) && pos.legal(ttData.move)
                 && !is_decisive(ttData.value))
             {
@@ -766,13 +973,17 @@ Value Search::Worker::search(
                 undo_move(pos, ttData.move);
 
                 // Check that the ttValue after the tt move would also trigger a cutoff
-                if (!is_valid(ttDataNext.value))
-                    return ttData.value;
-                if ((ttData.value >= beta) == (-ttDataNext.value >= beta))
-                    return ttData.value;
+                cutoff = !is_valid(ttDataNext.value)
+                      || (ttData.value >= beta) == (-ttDataNext.value >= beta);
             }
-            else
+
+            if (cutoff)
+            {
+                if constexpr (TreeStatsEnabled)
+                    ++treeStats.ttCutoffs;
+
                 return ttData.value;
+            }
         }
     }
 
@@ -932,9 +1143,15 @@ Value Search::Worker::search(
 
         undo_null_move(pos);
 
+        if constexpr (TreeStatsEnabled)
+            ++treeStats.nullMoveTries;
+
         // Do not return unproven mate or TB scores
         if (nullValue >= beta && !is_win(nullValue))
         {
+            if constexpr (TreeStatsEnabled)
+                ++treeStats.nullMoveCutoffs;
+
             if (thisThread->nmpMinPly || depth < 16)
                 return nullValue;
 
@@ -976,6 +1193,9 @@ Value Search::Worker::search(
         MovePicker mp(pos, ttData.move, probCutBeta - ss->staticEval, &thisThread->captureHistory);
         Depth      probCutDepth = std::max(depth - 5, 0);
 
+        if constexpr (TreeStatsEnabled)
+            ++treeStats.probCutTries;
+
         while ((move = mp.next_move()) != Move::none())
         {
             assert(move.is_ok());
@@ -1012,7 +1232,12 @@ Value Search::Worker::search(
                                probCutDepth + 1, move, unadjustedStaticEval, tt.generation());
 
                 if (!is_decisive(value))
+                {
+                    if constexpr (TreeStatsEnabled)
+                        ++treeStats.probCutCutoffs;
+
                     return value - (probCutBeta - beta);
+                }
             }
         }
     }
@@ -1037,9 +1262,22 @@ moves_loop:  // When in check, search starts here
 
     int moveCount = 0;
 
+    // Mark the node as being searched for the "Defer Busy Moves" option, moves
+    // postponed because another thread searches their child are revisited last.
+    BusyNodeMark busyMark(deferBusyMoves && depth >= BusyNodes::MinDepth && !excludedMove
+                            ? &threads.busyNodes
+                            : nullptr,
+                          posKey, depth, thisThread->threadIdx);
+    ValueList<Move, 32> deferredMoves;
+    size_t              deferredIdx = 0;
+
+    // Depth of the node for the branching factor statistics, before the loop changes it
+    [[maybe_unused]] const int statsDepth = std::min(int(depth), TreeStats::MaxDepth - 1);
+
     // Step 13. Loop through all pseudo-legal moves until no moves remain
     // or a beta cutoff occurs.
-    while ((move = mp.next_move()) != Move::none())
+    while ((move = mp.next_move()) != Move::none()
+           || (deferredIdx < deferredMoves.size() && (move = deferredMoves[deferredIdx++])))
     {
         assert(move.is_ok());
 
@@ -1058,6 +1296,15 @@ moves_loop:  // When in check, search starts here
                            thisThread->rootMoves.begin() + thisThread->pvLast, move))
             continue;
 
+        // Postpone the move if another thread is searching the resulting position
+        if (!PvNode && moveCount && !deferredIdx && deferredMoves.size() < 32
+            && busyMark.active() && move.type_of() == NORMAL
+            && threads.busyNodes.busy(pos.key_after(move), depth - 1, thisThread->threadIdx))
+        {
+            deferredMoves.push_back(move);
+            continue;
+        }
+
         ss->moveCount = ++moveCount;
 
         if (rootNode && is_mainthread() && nodes > 10000000)
@@ -1253,7 +1500,7 @@ moves_loop:  // When in check, search starts here
 
         // These reduction adjustments have no proven non-linear scaling
 
-        r += 316;  // Base reduction offset to compensate for other tweaks
+        r += 316 + lmrOffset;  // Base reduction offset to compensate for other tweaks
         r -= moveCount * 66;
         r -= std::abs(correctionValue) / 28047;
 
@@ -1305,6 +1552,9 @@ moves_loop:  // When in check, search starts here
             value         = -search<NonPV>(pos, ss + 1, -(alpha + 1), -alpha, d, true);
             ss->reduction = 0;
 
+            if constexpr (TreeStatsEnabled)
+                ++treeStats.lmrSearches;
+
             // Do a full-depth search when reduced LMR search fails high
             // (*Scaler) Usually doing more shallower searches
             // doesn't scale well to longer TCs
@@ -1318,8 +1568,13 @@ moves_loop:  // When in check, search starts here
                 newDepth += doDeeperSearch - doShallowerSearch;
 
                 if (newDepth > d)
+                {
                     value = -search<NonPV>(pos, ss + 1, -(alpha + 1), -alpha, newDepth, !cutNode);
 
+                    if constexpr (TreeStatsEnabled)
+                        ++treeStats.lmrResearches;
+                }
+
                 // Post LMR continuation history updates
                 update_continuation_histories(ss, movedPiece, move.to_sq(), 1508);
             }
@@ -1364,7 +1619,7 @@ moves_loop:  // When in check, search starts here
         // Finished searching the move. If a stop occurred, the return value of
         // the search cannot be trusted, and we return immediately without updating
         // best move, principal variation nor transposition table.
-        if (threads.stop.load(std::memory_order_relaxed))
+        if (stopped())
             return VALUE_ZERO;
 
         if (rootNode)
@@ -1437,6 +1692,12 @@ moves_loop:  // When in check, search starts here
 
                 if (value >= beta)
                 {
+                    if constexpr (TreeStatsEnabled)
+                    {
+                        ++treeStats.cutoffs;
+                        treeStats.firstMoveCutoffs += moveCount == 1;
+                    }
+
                     // (* Scaler) Especially if they make cutoffCnt increment more often.
                     ss->cutoffCnt += (extension < 2) || PvNode;
                     assert(value >= beta);  // Fail high
@@ -1470,6 +1731,12 @@ moves_loop:  // When in check, search starts here
 
     assert(moveCount || !ss->inCheck || excludedMove || !MoveList<LEGAL>(pos).size());
 
+    if constexpr (TreeStatsEnabled)
+    {
+        ++treeStats.loopNodes[statsDepth];
+        treeStats.loopMoves[statsDepth] += moveCount;
+    }
+
     // Adjust best value for fail high cases
     if (bestValue >= beta && !is_decisive(bestValue) && !is_decisive(alpha))
         bestValue = (bestValue * depth + beta) / (depth + 1);
@@ -1570,6 +1837,9 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     assert(alpha >= -VALUE_INFINITE && alpha < beta && beta <= VALUE_INFINITE);
     assert(PvNode || (alpha == beta - 1));
 
+    if constexpr (TreeStatsEnabled)
+        ++treeStats.qsearchNodes;
+
     // Check if we have an upcoming move that draws by repetition
     if (alpha < VALUE_DRAW && pos.upcoming_repetition(ss->ply))
     {
@@ -1618,6 +1888,10 @@ Value Search::Worker::qsearch(Position& pos, Stack* ss, Value alpha, Value beta)
     ttData.value = ttHit ? value_from_tt(ttData.value, ss->ply, pos.rule50_count()) : VALUE_NONE;
     pvHit        = ttHit && ttData.is_pv;
 
+    if constexpr (TTStatsEnabled)
+        if (ttHit && ttData.move && !pos.pseudo_legal(ttData.move))
+            ++thisThread->ttStats.falseMatches;
+
     // At non-PV nodes we check for an early TT cutoff
     if (!PvNode && ttData.depth >= DEPTH_QS
         && is_valid(ttData.value)  // Can happen when !ttHit or when access race in probe()
@@ -1836,7 +2110,7 @@ TimePoint Search::Worker::elapsed_time() const { return main_manager()->tm.elaps
 
 Value Search::Worker::evaluate(const Position& pos) {
     return Eval::evaluate(networks[numaAccessToken], pos, accumulatorStack, refreshTable,
-                          optimism[pos.side_to_move()]);
+                          evalCache, optimism[pos.side_to_move()], evalStats);
 }
 
 namespace {
@@ -2045,7 +2319,8 @@ void SearchManager::check_time(Search::Worker& worker) {
       worker.completedDepth >= 1
       && ((worker.limits.use_time_management() && (elapsed > tm.maximum() || stopOnPonderhit))
           || (worker.limits.movetime && elapsed >= worker.limits.movetime)
-          || (worker.limits.nodes && worker.threads.nodes_searched() >= worker.limits.nodes)))
+          || (worker.limits.nodes && !worker.nodeBudget
+              && worker.threads.nodes_searched() >= worker.limits.nodes)))
         worker.threads.stop = worker.threads.abortedSearch = true;
 }
 
@@ -2190,11 +2465,21 @@ void SearchManager::pv(Search::Worker&           worker,
                        const TranspositionTable& tt,
                        Depth                     depth) {
 
+    // With "MultiPV Split" and "Split Root Moves" the main thread reports the
+    // lines of all the threads, the latter one line for each root move.
+    const bool         shared = worker.multiPVSplit || worker.rootMoveSplit;
+    RootMoves          sharedLines;
+    std::vector<Depth> sharedDepths;
+    if (shared)
+        threads.sharedPVLines.lines(sharedLines, sharedDepths);
+
     const auto nodes     = threads.nodes_searched();
-    auto&      rootMoves = worker.rootMoves;
+    auto&      rootMoves = shared ? sharedLines : worker.rootMoves;
     auto&      pos       = worker.rootPos;
     size_t     pvIdx     = worker.pvIdx;
-    size_t     multiPV   = std::min(size_t(worker.options["MultiPV"]), rootMoves.size());
+    size_t     multiPV   = worker.rootMoveSplit
+                           ? rootMoves.size()
+                           : std::min(size_t(worker.options["MultiPV"]), rootMoves.size());
     uint64_t   tbHits    = threads.tb_hits() + (worker.tbConfig.rootInTB ? rootMoves.size() : 0);
 
     for (size_t i = 0; i < multiPV; ++i)
@@ -2204,7 +2489,7 @@ void SearchManager::pv(Search::Worker&           worker,
         if (depth == 1 && !updated && i > 0)
             continue;
 
-        Depth d = updated ? depth : std::max(1, depth - 1);
+        Depth d = shared ? sharedDepths[i] : updated ? depth : std::max(1, depth - 1);
         Value v = updated ? rootMoves[i].uciScore : rootMoves[i].previousScore;
 
         if (v == -VALUE_INFINITE)
@@ -2213,7 +2498,8 @@ void SearchManager::pv(Search::Worker&           worker,
         bool tb = worker.tbConfig.rootInTB && std::abs(v) <= VALUE_TB;
         v       = tb ? rootMoves[i].tbScore : v;
 
-        bool isExact = i != pvIdx || tb || !updated;  // tablebase- and previous-scores are exact
+        bool isExact =
+          i != pvIdx || tb || !updated || shared;  // tablebase-, previous- and merged scores are exact
 
         // Potentially correct and extend the PV, and in exceptional cases v
         if (is_decisive(v) && std::abs(v) < VALUE_MATE_IN_MAX_PLY
@@ -2256,6 +2542,246 @@ void SearchManager::pv(Search::Worker&           worker,
     }
 }
 
+void SharedPVLines::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    published.clear();
+}
+
+// Stores a finished line, unless a deeper line for the same move is known
+void SharedPVLines::publish(const RootMove& rm, Depth depth) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = std::find_if(published.begin(), published.end(),
+                           [&](const Line& l) { return l.rootMove.pv[0] == rm.pv[0]; });
+
+    if (it == published.end())
+        published.push_back({rm, depth});
+    else if (depth >= it->depth)
+        *it = {rm, depth};
+}
+
+// Returns the published lines, best first. Lines more than one ply shallower
+// than the deepest one are stale: the move dropped out of the best lines since,
+// so they go last whatever their score.
+std::vector<SharedPVLines::Line> SharedPVLines::sorted() const {
+
+    std::vector<Line> lines    = published;
+    Depth             maxDepth = 0;
+
+    for (const Line& l : lines)
+        maxDepth = std::max(maxDepth, l.depth);
+
+    std::stable_sort(lines.begin(), lines.end(), [&](const Line& a, const Line& b) {
+        bool aFresh = a.depth >= maxDepth - 1, bFresh = b.depth >= maxDepth - 1;
+        return aFresh != bFresh ? aFresh : aFresh ? a.rootMove < b.rootMove : a.depth > b.depth;
+    });
+
+    return lines;
+}
+
+// Orders the root moves as the published lines and copies their results, the
+// moves without a published line get no score and keep their relative order.
+void SharedPVLines::merge_into(RootMoves& rootMoves) const {
+
+    std::vector<Line> lines;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lines = sorted();
+    }
+
+    for (RootMove& rm : rootMoves)
+        rm.score = -VALUE_INFINITE;
+
+    for (auto l = lines.rbegin(); l != lines.rend(); ++l)
+    {
+        auto it = std::find(rootMoves.begin(), rootMoves.end(), l->rootMove.pv[0]);
+        if (it == rootMoves.end())
+            continue;
+
+        it->score           = l->rootMove.score;
+        it->uciScore        = l->rootMove.uciScore;
+        it->scoreLowerbound = l->rootMove.scoreLowerbound;
+        it->scoreUpperbound = l->rootMove.scoreUpperbound;
+        it->selDepth        = l->rootMove.selDepth;
+        it->pv              = l->rootMove.pv;
+
+        std::rotate(rootMoves.begin(), it, it + 1);
+    }
+}
+
+// Gets copies of the published lines, best first, with their depths
+void SharedPVLines::lines(RootMoves& rootMoves, std::vector<Depth>& depths) const {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (const Line& l : sorted())
+    {
+        rootMoves.push_back(l.rootMove);
+        depths.push_back(l.depth);
+    }
+}
+
+bool SharedPVLines::empty() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return published.empty();
+}
+
+// Keeps the root moves of the search just finished, and the keys of the root
+// and of the positions along the best line.
+void SearchManager::save_root(Position& pos, const RootMoves& rootMoves) {
+
+    const std::vector<Move>& line = rootMoves[0].pv;
+    std::vector<StateInfo>   states(line.size());
+
+    previousRootMoves = rootMoves;
+    previousLineKeys  = {pos.state()->key};
+
+    for (size_t i = 0; i < line.size() && line[i] != Move::none(); ++i)
+    {
+        pos.do_move(line[i], states[i]);
+        previousLineKeys.push_back(pos.state()->key);
+    }
+
+    for (size_t i = previousLineKeys.size() - 1; i > 0; --i)
+        pos.undo_move(line[i - 1]);
+}
+
+// Starts the root moves of a new search from the score statistics of the last
+// one, so that the first iterations get a good order and narrow aspiration
+// windows. If the root is the same, every root move takes its own statistics
+// back. If the root was reached along the best line, the move expected there
+// takes those of the best root move, negated when the other side is to move.
+void SearchManager::reuse_root(const Position& pos, RootMoves& rootMoves) const {
+
+    auto found = std::find(previousLineKeys.begin(), previousLineKeys.end(), pos.state()->key);
+    if (found == previousLineKeys.end())
+        return;
+
+    size_t ply = found - previousLineKeys.begin();
+
+    if (ply == 0)
+    {
+        for (RootMove& rm : rootMoves)
+        {
+            auto prev = std::find(previousRootMoves.begin(), previousRootMoves.end(), rm.pv[0]);
+            if (prev == previousRootMoves.end())
+                continue;
+
+            rm.previousScore =
+              prev->score != -VALUE_INFINITE ? prev->score : prev->previousScore;
+            rm.averageScore     = prev->averageScore;
+            rm.meanSquaredScore = prev->meanSquaredScore;
+        }
+
+        std::stable_sort(rootMoves.begin(), rootMoves.end(),
+                         [](const RootMove& a, const RootMove& b) {
+                             return a.previousScore != b.previousScore
+                                    ? a.previousScore > b.previousScore
+                                    : a.averageScore > b.averageScore;
+                         });
+        return;
+    }
+
+    const RootMove& best = previousRootMoves[0];
+
+    if (ply >= best.pv.size() || best.score == -VALUE_INFINITE
+        || best.averageScore == -VALUE_INFINITE)
+        return;
+
+    auto expected = std::find(rootMoves.begin(), rootMoves.end(), best.pv[ply]);
+    if (expected == rootMoves.end())
+        return;
+
+    const int sign = ply % 2 ? -1 : 1;
+
+    expected->previousScore    = sign * best.score;
+    expected->averageScore     = sign * best.averageScore;
+    expected->meanSquaredScore = sign * best.meanSquaredScore;
+
+    std::rotate(rootMoves.begin(), expected, expected + 1);
+}
+
+// Builds the roots of the replies to ponder on besides the ponder move, for a
+// ponder search started on the ponder move of the last search. The replies
+// are the count - 1 best ones for the opponent according to the TT entries of
+// the positions they lead to, and the replies without such an entry are left
+// out. The root states link to the position before the ponder move, so that
+// repetitions are found as for the ponder move.
+std::vector<PonderRoot>
+SearchManager::ponder_roots(Position& pos, const TranspositionTable& tt, size_t count) const {
+
+    std::vector<PonderRoot>            roots;
+    std::vector<std::pair<Value, int>> order;
+
+    if (count < 2 || previousLineKeys.size() < 3 || pos.state()->key != previousLineKeys[2]
+        || !pos.state()->previous || pos.state()->previous->key != previousLineKeys[1])
+        return roots;
+
+    const Move ponderMove = previousRootMoves[0].pv[1];
+    StateInfo* rootSt     = pos.state();
+    StateInfo  st;
+
+    pos.undo_move(ponderMove);
+
+    for (const auto& m : MoveList<LEGAL>(pos))
+    {
+        if (m == ponderMove)
+            continue;
+
+        pos.do_move(m, st);
+
+        auto [ttHit, ttData, ttWriter] = tt.probe(pos.key());
+        MoveList<LEGAL> replies(pos);
+
+        if (ttHit && ttData.value != VALUE_NONE && replies.size())
+        {
+            PonderRoot root{pos.fen(), st, {}};
+            for (const auto& reply : replies)
+                root.rootMoves.emplace_back(reply);
+
+            order.emplace_back(ttData.value, int(roots.size()));
+            roots.push_back(std::move(root));
+        }
+
+        pos.undo_move(m);
+    }
+
+    pos.do_move(ponderMove, *rootSt);
+
+    // The TT values are from our point of view, so the opponent prefers the lowest
+    std::stable_sort(order.begin(), order.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<PonderRoot> best;
+    for (size_t i = 0; i < order.size() && i + 1 < count; ++i)
+        best.push_back(std::move(roots[order[i].second]));
+
+    return best;
+}
+
+// Records the outcome of the last ponder search, if not known yet. The search
+// was either followed by a ponderhit, or stopped and followed by a search of
+// the given root, which may be one of the other replies it pondered on.
+void SearchManager::ponder_outcome(bool ponderhit, Key root) {
+
+    if (ponderedKeys.empty())
+        return;
+
+    auto found = std::find(ponderedKeys.begin(), ponderedKeys.end(), root);
+
+    ++ponderStats.searches;
+
+    if (ponderhit || found == ponderedKeys.begin())
+        ++ponderStats.hits;
+    else if (found != ponderedKeys.end())
+        ++ponderStats.candidateHits;
+
+    ponderStats.updated = true;
+
+    ponderedKeys.clear();
+}
+
 // Called in case we have no ponder move before exiting the search,
 // for instance, in case we stop the search during a fail high at root.
 // We try hard to have a ponder move to return to the GUI,
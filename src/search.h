@@ -27,6 +27,7 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -40,6 +41,7 @@
 #include "score.h"
 #include "syzygy/tbprobe.h"
 #include "timeman.h"
+#include "tt.h"
 #include "evaluate.h"
 #include "types.h"
 
@@ -113,6 +115,14 @@ struct RootMove {
 
 using RootMoves = std::vector<RootMove>;
 
+// Root position of a thread, given by its FEN and its state, whose previous
+// states are the ones of the game, and its root moves.
+struct PonderRoot {
+    std::string fen;
+    StateInfo   state;
+    RootMoves   rootMoves;
+};
+
 
 // LimitsType struct stores information sent by the caller about the analysis required.
 struct LimitsType {
@@ -155,6 +165,125 @@ struct SharedState {
 
 class Worker;
 
+#ifdef SEARCH_STATS
+constexpr bool TreeStatsEnabled = true;
+#else
+constexpr bool TreeStatsEnabled = false;
+#endif
+
+// Counters of the search tree, only updated in builds with stats=yes. Each
+// worker owns one, so that they are plain integers.
+struct TreeStats {
+    static constexpr int MaxDepth = 32;  // Deeper nodes are counted at MaxDepth - 1
+
+    uint64_t pvNodes = 0, nonPvNodes = 0, qsearchNodes = 0;
+    uint64_t cutoffs = 0, firstMoveCutoffs = 0;  // Fail highs in the move loop, by its first move
+    uint64_t ttCutoffs = 0;                      // Returns on a TT hit, only at non-PV nodes
+    uint64_t nullMoveTries = 0, nullMoveCutoffs = 0;
+    uint64_t lmrSearches = 0, lmrResearches = 0;  // Reduced searches, re-searched at full depth
+    uint64_t probCutTries = 0, probCutCutoffs = 0;
+    uint64_t loopNodes[MaxDepth] = {};  // Nodes reaching the move loop, by depth
+    uint64_t loopMoves[MaxDepth] = {};  // Moves searched by these nodes
+
+    TreeStats& operator+=(const TreeStats& other) {
+        pvNodes += other.pvNodes;
+        nonPvNodes += other.nonPvNodes;
+        qsearchNodes += other.qsearchNodes;
+        cutoffs += other.cutoffs;
+        firstMoveCutoffs += other.firstMoveCutoffs;
+        ttCutoffs += other.ttCutoffs;
+        nullMoveTries += other.nullMoveTries;
+        nullMoveCutoffs += other.nullMoveCutoffs;
+        lmrSearches += other.lmrSearches;
+        lmrResearches += other.lmrResearches;
+        probCutTries += other.probCutTries;
+        probCutCutoffs += other.probCutCutoffs;
+        for (int d = 0; d < MaxDepth; ++d)
+        {
+            loopNodes[d] += other.loopNodes[d];
+            loopMoves[d] += other.loopMoves[d];
+        }
+        return *this;
+    }
+};
+
+// Ways to make the helper threads of Lazy SMP search differently from the
+// main thread, combined as bits in the "SMP Diversity" option
+enum SMPDiversity {
+    SkipDepths      = 1,  // Helpers skip some iterations, following patterns by thread
+    RotateRootMoves = 2,  // Helpers search one of the best few root moves first
+    PerturbLMR      = 4   // Helpers reduce slightly more or less than the main thread
+};
+
+// Small lock-free table of the nodes currently being searched, used by the
+// "Defer Busy Moves" option (an ABDADA-like scheme). A thread claims the slot
+// of a node for as long as it loops over its moves, and siblings at non-PV
+// nodes postpone moves leading to a node claimed by another thread. Races
+// between the key and the owner only make a lookup miss or hit spuriously.
+class BusyNodes {
+   public:
+    static constexpr size_t Size     = 8192;
+    static constexpr Depth  MinDepth = 4;  // Shallower nodes are not marked
+
+    BusyNodes() :
+        slots(new Slot[Size]()) {}
+
+    // Claims the slot of the node, returns false if it is held already
+    bool enter(Key key, Depth depth, size_t threadIdx) {
+        Slot&    slot     = slots[key & (Size - 1)];
+        uint32_t expected = 0;
+        if (!slot.owner.compare_exchange_strong(expected, uint32_t(threadIdx + 1) << 8 | depth,
+                                                std::memory_order_relaxed))
+            return false;
+        slot.key.store(key, std::memory_order_relaxed);
+        return true;
+    }
+
+    void leave(Key key) { slots[key & (Size - 1)].owner.store(0, std::memory_order_relaxed); }
+
+    // Whether another thread searches the node at least at the given depth
+    bool busy(Key key, Depth depth, size_t threadIdx) const {
+        const Slot& slot  = slots[key & (Size - 1)];
+        uint32_t    owner = slot.owner.load(std::memory_order_relaxed);
+        return owner && (owner >> 8) != threadIdx + 1 && Depth(owner & 0xFF) >= depth
+            && slot.key.load(std::memory_order_relaxed) == key;
+    }
+
+   private:
+    struct Slot {
+        std::atomic<Key>      key;
+        std::atomic<uint32_t> owner;  // Thread index + 1 and depth, 0 when free
+    };
+
+    std::unique_ptr<Slot[]> slots;
+};
+
+// PV lines shared between the threads when the "MultiPV Split" option
+// distributes the MultiPV lines over them. Every thread publishes the lines
+// it has finished, and orders its root moves by the published lines at the
+// start of each iteration, so that the lines it excludes from its own slots
+// are the best ones found so far by any thread. The main thread reports the
+// merged lines.
+class SharedPVLines {
+   public:
+    void clear();
+    void publish(const RootMove& rm, Depth depth);
+    void merge_into(RootMoves& rootMoves) const;
+    void lines(RootMoves& rootMoves, std::vector<Depth>& depths) const;
+    bool empty() const;
+
+   private:
+    struct Line {
+        RootMove rootMove;
+        Depth    depth;
+    };
+
+    std::vector<Line> sorted() const;
+
+    mutable std::mutex mutex;
+    std::vector<Line>  published;
+};
+
 // Null Object Pattern, implement a common interface for the SearchManagers.
 // A Null Object will be given to non-mainthread workers.
 class ISearchManager {
@@ -242,6 +371,13 @@ class SearchManager: public ISearchManager {
             const TranspositionTable& tt,
             Depth                     depth);
 
+    void save_root(Position& pos, const RootMoves& rootMoves);
+    void reuse_root(const Position& pos, RootMoves& rootMoves) const;
+
+    std::vector<PonderRoot>
+         ponder_roots(Position& pos, const TranspositionTable& tt, size_t count) const;
+    void ponder_outcome(bool ponderhit, Key root);
+
     Hypnos::TimeManagement tm;
     double                    originalTimeAdjust;
     int                       callsCnt;
@@ -253,6 +389,22 @@ class SearchManager: public ISearchManager {
     Value                bestPreviousAverageScore;
     bool                 stopOnPonderhit;
 
+    // Root moves of the last search, best first, and the keys of the root and of
+    // the positions along the best line, see reuse_root(). These
+    // are StateInfo keys, without the rule50 adjustment of Position::key(), so
+    // that they compare with the keys of earlier states, as do ponderedKeys.
+    RootMoves        previousRootMoves;
+    std::vector<Key> previousLineKeys;
+
+    // Keys of the roots the ongoing ponder search ponders on, the ponder move's
+    // first, until its outcome is known, and the outcomes so far. Candidate hits
+    // are the misses where the opponent played another reply pondered on.
+    std::vector<Key> ponderedKeys;
+    struct {
+        uint64_t searches = 0, hits = 0, candidateHits = 0;
+        bool     updated  = false;
+    } ponderStats;
+
     size_t id;
 
     const UpdateContext& updates;
@@ -317,6 +469,9 @@ class Worker {
 
     Depth reduction(bool i, Depth d, int mn, int delta) const;
 
+    bool stopped() const;
+    void sync_iteration();
+
     // Pointer to the search manager, only allowed to be called by the main thread
     SearchManager* main_manager() const {
         assert(threadIdx == 0);
@@ -345,6 +500,30 @@ class Worker {
     size_t                    threadIdx;
     NumaReplicatedAccessToken numaAccessToken;
 
+    // Diversification of helper threads, see SMPDiversity
+    int    diversity, lmrOffset;
+    size_t rootRotation;
+    bool   deferBusyMoves;
+
+    // Whether this search distributes the MultiPV lines over the threads, and
+    // over how many groups of threads.
+    bool   multiPVSplit;
+    size_t splitGroups;
+
+    // Whether each root move is searched by its own group of threads
+    bool rootMoveSplit;
+
+    // Whether this thread ponders on another reply than the ponder move, and
+    // the root of the ponder move, which the thread searches after a ponderhit.
+    bool       ponderSibling = false;
+    PonderRoot ponderRoot;
+
+    // Deterministic multi-threaded search, see sync_iteration(). Each thread
+    // stops on its own share of the nodes, and holds back its TT writes.
+    bool                             deterministic, nodeBudgetExhausted;
+    uint64_t                         nodeBudget;
+    std::unique_ptr<TTDeferredTable> deferredWrites;
+
     // Reductions lookup table initialized at startup
     std::array<int, MAX_MOVES> reductions;  // [depth or moveNumber]
 
@@ -361,6 +540,10 @@ class Worker {
     // Used by NNUE
     Eval::NNUE::AccumulatorStack  accumulatorStack;
     Eval::NNUE::AccumulatorCaches refreshTable;
+    Eval::EvalCache               evalCache;
+    Eval::EvalStats               evalStats;
+    TTStats                       ttStats;
+    TreeStats                     treeStats;
 
     friend class Hypnos::ThreadPool;
     friend class SearchManager;
@@ -133,6 +133,36 @@ Search::SearchManager* ThreadPool::main_manager() { return main_thread()->worker
 uint64_t ThreadPool::nodes_searched() const { return accumulate(&Search::Worker::nodes); }
 uint64_t ThreadPool::tb_hits() const { return accumulate(&Search::Worker::tbHits); }
 
+// Sums the evaluation counters of all threads. Must not be called while
+// the threads are searching.
+Eval::EvalStats ThreadPool::eval_stats() const {
+
+    Eval::EvalStats stats;
+    for (auto&& th : threads)
+        stats += th->worker->evalStats;
+    return stats;
+}
+
+// Sums the transposition table counters of all threads. Must not be called
+// while the threads are searching.
+TTStats ThreadPool::tt_stats() const {
+
+    TTStats stats;
+    for (auto&& th : threads)
+        stats += th->worker->ttStats;
+    return stats;
+}
+
+// Sums the search tree counters of all threads. Must not be called while the
+// threads are searching.
+Search::TreeStats ThreadPool::tree_stats() const {
+
+    Search::TreeStats stats;
+    for (auto&& th : threads)
+        stats += th->worker->treeStats;
+    return stats;
+}
+
 // Creates/destroys threads to match the requested number.
 // Created and launched threads will immediately go to sleep in idle_loop.
 // Upon resizing, threads are recreated to allow for binding if necessary.
@@ -220,6 +250,8 @@ void ThreadPool::clear() {
     main_manager()->bestPreviousScore  = VALUE_INFINITE;
     main_manager()->originalTimeAdjust = -1;
     main_manager()->tm.clear();
+    main_manager()->previousRootMoves.clear();
+    main_manager()->previousLineKeys.clear();
 }
 
 void ThreadPool::run_on_thread(size_t threadId, std::function<void()> f) {
@@ -248,6 +280,7 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
     main_manager()->ponder                                 = limits.ponderMode;
 
     increaseDepth = true;
+    syncArrivals  = 0;
 
     Search::RootMoves rootMoves;
     const auto        legalmoves = MoveList<LEGAL>(pos);
@@ -266,6 +299,9 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
 
     Tablebases::Config tbConfig = Tablebases::rank_root_moves(options, pos, rootMoves);
 
+    if (options["Reuse Root Moves"] && !tbConfig.rootInTB)
+        main_manager()->reuse_root(pos, rootMoves);
+
     // After ownership transfer 'states' becomes empty, so if we stop the search
     // and call 'go' again without setting a new position states.get() == nullptr.
     assert(states.get() || setupStates.get());
@@ -273,6 +309,29 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
     if (states.get())
         setupStates = std::move(states);  // Ownership transfer, states is now empty
 
+    // Unless a ponderhit ended the last ponder search, a stop did
+    main_manager()->ponder_outcome(false, pos.state()->key);
+
+    // With "Ponder Candidates" above 1, the helper threads also ponder on other
+    // likely replies than the ponder move, so that the TT is warm for whichever
+    // move the opponent plays. Thread i searches the root i % roots, the first
+    // root being the ponder move's one.
+    std::vector<Search::PonderRoot> ponderRoots;
+
+    if (limits.ponderMode)
+    {
+        size_t candidates = std::min(size_t(options["Ponder Candidates"]), size());
+
+        if (candidates > 1 && int(options["MultiPV"]) == 1 && !options["Deterministic SMP"]
+            && !options["Split Root Moves"] && !tbConfig.rootInTB)
+            ponderRoots = main_manager()->ponder_roots(pos, main_thread()->worker->tt, candidates);
+
+        main_manager()->ponderedKeys = {pos.state()->key};
+
+        for (const auto& root : ponderRoots)
+            main_manager()->ponderedKeys.push_back(root.state.key);
+    }
+
     // We use Position::set() to set root position across threads. But there are
     // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
     // be deduced from a fen string, so set() clears them and they are set from
@@ -285,10 +344,25 @@ void ThreadPool::start_thinking(const OptionsMap&  options,
             th->worker->nodes = th->worker->tbHits = th->worker->nmpMinPly =
               th->worker->bestMoveChanges          = 0;
             th->worker->rootDepth = th->worker->completedDepth = 0;
-            th->worker->rootMoves                              = rootMoves;
-            th->worker->rootPos.set(pos.fen(), pos.is_chess960(), &th->worker->rootState);
-            th->worker->rootState = setupStates->back();
-            th->worker->tbConfig  = tbConfig;
+            th->worker->tbConfig                               = tbConfig;
+
+            size_t r                  = th->id() % (ponderRoots.size() + 1);
+            th->worker->ponderSibling = r > 0;
+
+            if (r > 0)
+            {
+                th->worker->ponderRoot = {pos.fen(), setupStates->back(), rootMoves};
+                th->worker->rootMoves  = ponderRoots[r - 1].rootMoves;
+                th->worker->rootPos.set(ponderRoots[r - 1].fen, pos.is_chess960(),
+                                        &th->worker->rootState);
+                th->worker->rootState = ponderRoots[r - 1].state;
+            }
+            else
+            {
+                th->worker->rootMoves = rootMoves;
+                th->worker->rootPos.set(pos.fen(), pos.is_chess960(), &th->worker->rootState);
+                th->worker->rootState = setupStates->back();
+            }
         });
     }
 
@@ -306,9 +380,15 @@ Thread* ThreadPool::get_best_thread() const {
     std::unordered_map<Move, int64_t, Move::MoveHash> votes(
       2 * std::min(size(), bestThread->worker->rootMoves.size()));
 
+    // Threads left on another reply than the ponder move take no part in the vote
+    auto same_root = [&](const std::unique_ptr<Thread>& th) {
+        return th->worker->rootPos.key() == bestThread->worker->rootPos.key();
+    };
+
     // Find the minimum score of all threads
     for (auto&& th : threads)
-        minScore = std::min(minScore, th->worker->rootMoves[0].score);
+        if (same_root(th))
+            minScore = std::min(minScore, th->worker->rootMoves[0].score);
 
     // Vote according to score and depth, and select the best thread
     auto thread_voting_value = [minScore](Thread* th) {
@@ -316,10 +396,14 @@ Thread* ThreadPool::get_best_thread() const {
     };
 
     for (auto&& th : threads)
-        votes[th->worker->rootMoves[0].pv[0]] += thread_voting_value(th.get());
+        if (same_root(th))
+            votes[th->worker->rootMoves[0].pv[0]] += thread_voting_value(th.get());
 
     for (auto&& th : threads)
     {
+        if (!same_root(th))
+            continue;
+
         const auto bestThreadScore = bestThread->worker->rootMoves[0].score;
         const auto newThreadScore  = th->worker->rootMoves[0].score;
 
@@ -383,6 +467,47 @@ void ThreadPool::wait_for_search_finished() const {
             th->wait_for_search_finished();
 }
 
+// Blocks the calling thread until the condition holds. The condition must only
+// become true through changes followed by a call to notify_waiting().
+void ThreadPool::wait_until(const std::function<bool()>& condition) {
+
+    std::unique_lock<std::mutex> lk(waitMutex);
+    waitCondition.wait(lk, condition);
+}
+
+// Wakes up the threads in wait_until() to check their condition again. Taking
+// the mutex makes sure that a change made before cannot be missed by a thread
+// about to wait.
+void ThreadPool::notify_waiting() {
+
+    { std::lock_guard<std::mutex> lk(waitMutex); }
+
+    waitCondition.notify_all();
+}
+
+// Barrier for the search threads, returning once all of them have called it or
+// the search is stopped. The last thread to arrive runs lastArrival() before
+// releasing the others.
+void ThreadPool::sync(const std::function<void()>& lastArrival) {
+
+    std::unique_lock<std::mutex> lk(waitMutex);
+
+    if (stop)
+        return;
+
+    if (++syncArrivals == threads.size())
+    {
+        syncArrivals = 0;
+        ++syncRound;
+        lastArrival();
+        waitCondition.notify_all();
+        return;
+    }
+
+    const uint64_t round = syncRound;
+    waitCondition.wait(lk, [&] { return syncRound != round || stop; });
+}
+
 std::vector<size_t> ThreadPool::get_bound_thread_count_by_numa_node() const {
     std::vector<size_t> counts;
 
@@ -402,6 +527,11 @@ std::vector<size_t> ThreadPool::get_bound_thread_count_by_numa_node() const {
     return counts;
 }
 
+// Returns the node the thread is bound to, 0 if threads are not bound
+NumaIndex ThreadPool::get_numa_node_of_thread(size_t threadId) const {
+    return boundThreadToNumaNode.empty() ? 0 : boundThreadToNumaNode[threadId];
+}
+
 void ThreadPool::ensure_network_replicated() {
     for (auto&& th : threads)
         th->ensure_network_replicated();
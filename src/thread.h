@@ -142,15 +142,24 @@ class ThreadPool {
     Thread*                main_thread() const { return threads.front().get(); }
     uint64_t               nodes_searched() const;
     uint64_t               tb_hits() const;
+    Eval::EvalStats        eval_stats() const;
+    TTStats                tt_stats() const;
+    Search::TreeStats      tree_stats() const;
     Thread*                get_best_thread() const;
     void                   start_searching();
     void                   wait_for_search_finished() const;
+    void                   wait_until(const std::function<bool()>& condition);
+    void                   notify_waiting();
+    void                   sync(const std::function<void()>& lastArrival);
 
     std::vector<size_t> get_bound_thread_count_by_numa_node() const;
+    NumaIndex           get_numa_node_of_thread(size_t threadId) const;
 
     void ensure_network_replicated();
 
-    std::atomic_bool stop, abortedSearch, increaseDepth;
+    std::atomic_bool      stop, abortedSearch, increaseDepth;
+    Search::BusyNodes     busyNodes;
+    Search::SharedPVLines sharedPVLines;
 
     auto cbegin() const noexcept { return threads.cbegin(); }
     auto begin() noexcept { return threads.begin(); }
@@ -163,6 +172,10 @@ class ThreadPool {
     StateListPtr                         setupStates;
     std::vector<std::unique_ptr<Thread>> threads;
     std::vector<NumaIndex>               boundThreadToNumaNode;
+    std::mutex                           waitMutex;
+    std::condition_variable              waitCondition;
+    size_t                               syncArrivals = 0;
+    uint64_t                             syncRound    = 0;
 
     uint64_t accumulate(std::atomic<uint64_t> Search::Worker::* member) const {
 
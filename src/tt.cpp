@@ -18,10 +18,14 @@
 
 #include "tt.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
 
 #include "memory.h"
@@ -31,6 +35,19 @@
 
 namespace Hypnos {
 
+namespace {
+
+// Statistics of the current thread, see TranspositionTable::bind_stats()
+thread_local TTStats* threadStats = nullptr;
+
+// Node table of the current thread, see TranspositionTable::bind_node_table()
+thread_local const TTNodeTable* threadNodeTable = nullptr;
+
+// Held back writes of the current thread, see TranspositionTable::bind_deferred_table()
+thread_local TTDeferredTable* threadDeferredTable = nullptr;
+
+}  // namespace
+
 
 // TTEntry struct is the 10 bytes transposition table entry, defined as below:
 //
@@ -62,6 +79,7 @@ struct TTEntry {
 
    private:
     friend class TranspositionTable;
+    friend struct TTWriter;
 
     uint16_t key16;
     uint8_t  depth8;
@@ -69,6 +87,9 @@ struct TTEntry {
     Move     move16;
     int16_t  value16;
     int16_t  eval16;
+
+   public:
+    static constexpr uint32_t KeyBits = 8 * sizeof(key16);  // Low bits of the key stored
 };
 
 // `genBound8` is where most of the details are. We use the following constants to manipulate 5 leading generation bits
@@ -101,6 +122,16 @@ void TTEntry::save(
     if (b == BOUND_EXACT || uint16_t(k) != key16 || d - DEPTH_ENTRY_OFFSET + 2 * pv > depth8 - 4
         || relative_age(generation8))
     {
+        if constexpr (TTStatsEnabled)
+            if (threadStats && (!is_occupied() || uint16_t(k) != key16))
+            {
+                ++threadStats->firstWrites;
+
+                if (is_occupied())
+                    ++(relative_age(generation8) ? threadStats->ageReplacements
+                                                 : threadStats->depthReplacements);
+            }
+
         assert(d > DEPTH_ENTRY_OFFSET);
         assert(d < 256 + DEPTH_ENTRY_OFFSET);
 
@@ -111,7 +142,13 @@ void TTEntry::save(
         eval16    = int16_t(ev);
     }
     else if (depth8 + DEPTH_ENTRY_OFFSET >= 5 && Bound(genBound8 & 0x3) != BOUND_EXACT)
+    {
         depth8--;
+
+        if constexpr (TTStatsEnabled)
+            if (threadStats)
+                ++threadStats->depthDecrements;
+    }
 }
 
 
@@ -125,12 +162,43 @@ uint8_t TTEntry::relative_age(const uint8_t generation8) const {
 }
 
 
-// TTWriter is but a very thin wrapper around the pointer
-TTWriter::TTWriter(TTEntry* tte) :
-    entry(tte) {}
+// Entries shallower than this go to the node tables, when there are some
+static constexpr Depth NodeTableMaxDepth = 3;
+
+// TTWriter is but a very thin wrapper around the pointers
+TTWriter::TTWriter(TTEntry*                  tte,
+                   TTEntry*                  nodeTte,
+                   const TranspositionTable* table,
+                   Key*                      keySlot) :
+    entry(tte),
+    nodeEntry(nodeTte),
+    tt(table),
+    fullKey(keySlot) {}
 
+// Without node tables, or after a hit in the global table, this writes to the
+// probed entry. Otherwise shallow data goes to the node table, and deep data to
+// the global one, moving there if the position was found in the node table.
 void TTWriter::write(
   Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8) {
+
+    if (fullKey)
+        *fullKey = k;
+
+    if (nodeEntry && d < NodeTableMaxDepth)
+    {
+        nodeEntry->save(k, v, pv, b, d, m, ev, generation8);
+        return;
+    }
+
+    if (!entry)
+    {
+        if (!m)
+            m = Move(nodeEntry->move16);
+
+        nodeEntry->depth8 = 0;  // So that the node table no longer shadows the new entry
+        entry             = std::get<2>(tt->probe_global(k)).entry;
+    }
+
     entry->save(k, v, pv, b, d, m, ev, generation8);
 }
 
@@ -138,26 +206,114 @@ void TTWriter::write(
 // A TranspositionTable is an array of Cluster, of size clusterCount. Each cluster consists of ClusterSize number
 // of TTEntry. Each non-empty TTEntry contains information on exactly one position. The size of a Cluster should
 // divide the size of a cache line for best performance, as the cacheline is prefetched when possible.
+// By default a cluster is half a cache line with 3 entries, building with ttcluster=64 makes it a full
+// cache line with 6 entries, which may give more hits per memory access with large hashes.
 
-static constexpr int ClusterSize = 3;
+#ifdef TT_CLUSTER_64
+static constexpr int    ClusterSize  = 6;
+static constexpr size_t ClusterBytes = 64;
+#else
+static constexpr int    ClusterSize  = 3;
+static constexpr size_t ClusterBytes = 32;
+#endif
 
 struct Cluster {
     TTEntry entry[ClusterSize];
-    char    padding[2];  // Pad to 32 bytes
+    uint8_t epoch8;  // TranspositionTable::epoch8 at the time of the last reset
+    char    padding[ClusterBytes - ClusterSize * sizeof(TTEntry) - 1];  // Pad to ClusterBytes
+
+    void reset(uint8_t epoch) {
+        std::memset(entry, 0, sizeof(entry));
+        epoch8 = epoch;
+    }
 };
 
-static_assert(sizeof(Cluster) == 32, "Suboptimal Cluster size");
+static_assert(sizeof(Cluster) == ClusterBytes, "Suboptimal Cluster size");
+
+
+// Splits [0, count) in one slice per thread of the pool, calls f(start, end)
+// on each thread with its slice and waits for all of them to finish.
+static void parallel_for(ThreadPool&                                threads,
+                         size_t                                     count,
+                         const std::function<void(size_t, size_t)>& f) {
+
+    const size_t threadCount = threads.num_threads();
+
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        threads.run_on_thread(i, [&f, i, count, threadCount]() {
+            const size_t stride = count / threadCount;
+            const size_t start  = stride * i;
+            const size_t end    = i + 1 != threadCount ? start + stride : count;
+
+            f(start, end);
+        });
+    }
+
+    for (size_t i = 0; i < threadCount; ++i)
+        threads.wait_on_thread(i);
+}
+
+
+// Returns a * b / c rounded down, or up if roundUp is set, without overflowing
+static uint64_t mul_div(uint64_t a, uint64_t b, uint64_t c, bool roundUp) {
+#if defined(__GNUC__) && defined(IS_64BIT)
+    __extension__ using uint128 = unsigned __int128;
+    return uint64_t((uint128(a) * uint128(b) + (roundUp ? c - 1 : 0)) / c);
+#else
+    // Only approximate, which may cost some entries at cluster boundaries
+    long double q = static_cast<long double>(a) * b / c;
+    return uint64_t(roundUp ? std::ceil(q) : std::floor(q));
+#endif
+}
 
 
 // Sets the size of the transposition table,
 // measured in megabytes. Transposition table consists
 // of clusters and each cluster consists of ClusterSize number of TTEntry.
-void TranspositionTable::resize(size_t mbSize, ThreadPool& threads) {
-    aligned_large_pages_free(table);
+// With preserve set, the entries of the old table are migrated to the new
+// one instead of being discarded, at the cost of holding both tables in
+// memory for the duration of the resize. With a non-empty sharedName, the
+// table is shared with the other local processes using the same name instead,
+// falling back to a private table if that fails. The placement decides on
+// which NUMA nodes the pages of a private table end up, and with useHugeTLB
+// explicit huge pages are tried first for it.
+void TranspositionTable::resize(size_t             mbSize,
+                                ThreadPool&        threads,
+                                bool               preserve,
+                                const std::string& sharedName,
+                                TTPlacement        newPlacement,
+                                bool               useHugeTLB) {
+    stop_clearing();
+
+    hugeTLB   = useHugeTLB;
+    placement = newPlacement;
+
+    // Entries are never migrated to or from a shared table
+    if (sharedHeader || !sharedName.empty())
+        free_table();
+
+    if (!sharedName.empty())
+    {
+        if (attach_shared(mbSize, sharedName))
+            return;
+
+        std::cerr << "Failed to attach to shared hash " << sharedName
+                  << ", using a private transposition table." << std::endl;
+    }
+
+    Cluster*     oldTable = table;
+    const size_t oldCount = clusterCount;
+
+    if (!preserve || !oldTable)
+    {
+        aligned_large_pages_free(oldTable);
+        oldTable = nullptr;
+    }
 
     clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
 
-    table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+    table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster), hugeTLB));
 
     if (!table)
     {
@@ -165,30 +321,386 @@ void TranspositionTable::resize(size_t mbSize, ThreadPool& threads) {
         exit(EXIT_FAILURE);
     }
 
-    clear(threads);
+    start_clearing(threads, true, false);
+
+    if (!oldTable)
+    {
+        generation8 = 0;
+        return;
+    }
+
+    finish_clearing();
+    migrate(oldTable, oldCount, threads);
+    aligned_large_pages_free(oldTable);
 }
 
 
-// Initializes the entire transposition table to zero,
-// in a multi-threaded way.
+// Entries shallower than this are not worth migrating on a resize
+static constexpr Depth MigrateMinDepth = 6;
+
+// Fills the freshly allocated table with the deep entries of the old one, in
+// parallel. Entries only store the low 16 bits of their key, so the exact new
+// cluster of an entry is unknown: it is copied to every new cluster that the
+// key range of its old cluster maps to, where the copies outside of its real
+// home are as good as empty slots. When the table grows, a new cluster overlaps
+// the key range of one or two old clusters, so the copies do not crowd out
+// other entries. When it shrinks, a new cluster gathers the entries of up to
+// ceil(oldCount / clusterCount) + 1 old clusters. Work is split by new cluster,
+// so that each one has a single writer, and when several entries compete for
+// a slot, the most valuable ones according to the replacement strategy of
+// probe() survive.
+void TranspositionTable::migrate(const Cluster* oldTable, size_t oldCount, ThreadPool& threads) {
+
+    parallel_for(threads, clusterCount, [&](size_t start, size_t end) {
+        for (size_t j = start; j < end; ++j)
+        {
+            // Old clusters i whose key range overlaps the one of new cluster j,
+            // i.e. those with j * oldCount / clusterCount - 1 < i < (j + 1) * oldCount / clusterCount
+            const size_t first = mul_div(j, oldCount, clusterCount, false);
+            const size_t last  = mul_div(j + 1, oldCount, clusterCount, true);
+
+            for (size_t i = first; i < last; ++i)
+            {
+                if (oldTable[i].epoch8 != epoch8)
+                    continue;
+
+                for (const TTEntry& e : oldTable[i].entry)
+                {
+                    if (!e.is_occupied() || e.depth8 + DEPTH_ENTRY_OFFSET < MigrateMinDepth)
+                        continue;
+
+                    TTEntry* replace = table[j].entry;
+
+                    for (TTEntry& slot : table[j].entry)
+                    {
+                        if (!slot.is_occupied())
+                        {
+                            replace = &slot;
+                            break;
+                        }
+
+                        if (replace->depth8 - replace->relative_age(generation8)
+                            > slot.depth8 - slot.relative_age(generation8))
+                            replace = &slot;
+                    }
+
+                    if (!replace->is_occupied()
+                        || replace->depth8 - replace->relative_age(generation8)
+                             < e.depth8 - e.relative_age(generation8))
+                        *replace = e;
+                }
+            }
+        }
+    });
+}
+
+
+// Empties the table without waiting for the memory to be zeroed: bumping the
+// epoch turns every cluster stale at once, so that probe() resets clusters on
+// first access while the threads of the pool zero the rest of the table. When
+// the epoch wraps around, clusters left stale by an aborted clear would match
+// it again, so the table is then zeroed entirely before returning. The node
+// tables are cleared in the same way with their own epoch. A shared table is
+// left alone, as other processes may be using it.
 void TranspositionTable::clear(ThreadPool& threads) {
-    generation8              = 0;
+    stop_clearing();
+
+    if (sharedHeader && !nodeTables)
+        return;
+
+    bool wrapped = false;
+
+    if (!sharedHeader)
+    {
+        generation8 = 0;
+        wrapped     = !++epoch8;
+    }
+
+    if (nodeTables)
+        wrapped |= !++nodeEpoch8;
+
+    start_clearing(threads, !sharedHeader && !epoch8, nodeTables != nullptr);
+
+    if (wrapped)
+        finish_clearing();
+}
+
+
+// Resets the clusters in [begin, end) of an older epoch, or all of them if all is set
+static void reset_clusters(Cluster* table, size_t begin, size_t end, uint8_t epoch, bool all) {
+    for (size_t i = begin; i < end; ++i)
+        if (all || table[i].epoch8 != epoch)
+            table[i].reset(epoch);
+}
+
+
+// Resets the clusters of an older epoch, or all of them if all is set, with the
+// threads of the pool and returns without waiting for them. Pages are only
+// backed by memory when first touched, so on a fresh table this is what decides
+// their NUMA node: a thread bound to a node resets pages that should live there,
+// according to the placement. Work is split by large page, so that no page is
+// shared between nodes, and stop_clearing() aborts it between pages unless all
+// is set. Without bound threads this is a plain parallel reset. With node tables,
+// the threads of each node also reset the stale clusters of its node table, or
+// all of them when the node epoch has wrapped around. A shared table is left
+// alone.
+void TranspositionTable::start_clearing(ThreadPool& threads, bool all, bool withNodeTables) {
+
+    constexpr size_t PageClusters = (size_t(2) << 20) / sizeof(Cluster);
+
     const size_t threadCount = threads.num_threads();
+    const size_t pageCount =
+      sharedHeader ? 0 : (clusterCount + PageClusters - 1) / PageClusters;
+    const bool allNodes = !nodeEpoch8;
+
+    // Group the threads by node, in order of first appearance
+    std::vector<NumaIndex>           nodes;
+    std::vector<std::vector<size_t>> nodeThreads;
 
     for (size_t i = 0; i < threadCount; ++i)
     {
-        threads.run_on_thread(i, [this, i, threadCount]() {
-            // Each thread will zero its part of the hash table
-            const size_t stride = clusterCount / threadCount;
-            const size_t start  = stride * i;
-            const size_t len    = i + 1 != threadCount ? stride : clusterCount - start;
+        const NumaIndex n  = threads.get_numa_node_of_thread(i);
+        auto            it = std::find(nodes.begin(), nodes.end(), n);
 
-            std::memset(&table[start], 0, len * sizeof(Cluster));
-        });
+        if (it == nodes.end())
+        {
+            nodes.push_back(n);
+            nodeThreads.emplace_back();
+            it = nodes.end() - 1;
+        }
+
+        nodeThreads[it - nodes.begin()].push_back(i);
     }
 
-    for (size_t i = 0; i < threadCount; ++i)
-        threads.wait_on_thread(i);
+    clearThreads = &threads;
+
+    size_t rank = 0;  // Position of the thread when ordered by node
+
+    for (size_t g = 0; g < nodes.size(); ++g)
+        for (size_t r = 0; r < nodeThreads[g].size(); ++r, ++rank)
+        {
+            const size_t id = nodeThreads[g][r];
+            size_t       first, last, step;
+
+            if (placement == TTPlacement::Interleave)
+            {
+                // Page k goes to node k % nodeCount, then round robin among its threads
+                first = g + nodes.size() * r;
+                last  = pageCount;
+                step  = nodes.size() * nodeThreads[g].size();
+            }
+            else
+            {
+                // Consecutive threads get consecutive slices of pages, ordered by
+                // node for a partitioned table and as in the pool otherwise.
+                const size_t slot = placement == TTPlacement::Partition ? rank : id;
+
+                first = slot * pageCount / threadCount;
+                last  = (slot + 1) * pageCount / threadCount;
+                step  = 1;
+            }
+
+            // The node table is split evenly between the threads of its node
+            const TTNodeTable* nodeTable = withNodeTables ? nodeTables->of_node(nodes[g]) : nullptr;
+            const size_t       nodeCount = nodeTable ? nodeTable->clusterCount : 0;
+            const size_t       nodeFirst = r * nodeCount / nodeThreads[g].size();
+            const size_t       nodeLast  = (r + 1) * nodeCount / nodeThreads[g].size();
+
+            threads.run_on_thread(id, [this, first, last, step, all, epoch = epoch8, nodeTable,
+                                       nodeFirst, nodeLast, allNodes, nodeEpoch = nodeEpoch8]() {
+                for (size_t page = first; page < last && (all || !abortClear); page += step)
+                    reset_clusters(table, page * PageClusters,
+                                   std::min((page + 1) * PageClusters, clusterCount), epoch, all);
+
+                for (size_t i = nodeFirst; i < nodeLast && (allNodes || !abortClear);
+                     i += PageClusters)
+                    reset_clusters(nodeTable->table, i, std::min(i + PageClusters, nodeLast),
+                                   nodeEpoch, allNodes);
+            });
+        }
+}
+
+
+// Stops the background clearing, if any. Clusters not reached yet stay stale
+// and are reset by probe() on first access. The reset of a fresh table is
+// always completed, as its clusters may hold anything.
+void TranspositionTable::stop_clearing() {
+
+    abortClear = true;
+    finish_clearing();
+    abortClear = false;
+}
+
+
+// Waits for the background clearing, if any, to reach every cluster
+void TranspositionTable::finish_clearing() {
+
+    if (!clearThreads)
+        return;
+
+    for (size_t i = 0; i < clearThreads->num_threads(); ++i)
+        clearThreads->wait_on_thread(i);
+
+    clearThreads = nullptr;
+}
+
+
+// A table dump starts with this header, followed by the raw Cluster array. The
+// layout fields make sure that a dump is only loaded back by a build using the
+// same entry format and the same mapping from keys to clusters.
+struct TTFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint32_t clusterSize;
+    uint32_t entriesPerCluster;
+    uint32_t keyBits;  // Low bits of the key stored in each entry, index from mul_hi64()
+    uint16_t generation8;
+    uint16_t epoch8;
+    uint64_t clusterCount;
+};
+
+static constexpr char     TTFileMagic[8] = {'H', 'y', 'p', 'n', 'o', 'S', 'T', 'T'};
+static constexpr uint32_t TTFileVersion  = 1;
+
+static TTFileHeader tt_file_header(size_t clusterCount, uint8_t generation8, uint8_t epoch8) {
+    TTFileHeader h;
+    std::memcpy(h.magic, TTFileMagic, sizeof(TTFileMagic));
+    h.version           = TTFileVersion;
+    h.entrySize         = sizeof(TTEntry);
+    h.clusterSize       = sizeof(Cluster);
+    h.entriesPerCluster = ClusterSize;
+    h.keyBits           = TTEntry::KeyBits;
+    h.generation8       = generation8;
+    h.epoch8            = epoch8;
+    h.clusterCount      = clusterCount;
+    return h;
+}
+
+
+// Writes the whole table to a file, so that it can be restored in a later
+// session. Must not be called while searching. Stale clusters are saved as
+// they are, together with the epoch telling them apart.
+bool TranspositionTable::save(const std::string& filename) {
+
+    stop_clearing();
+
+    std::ofstream stream(filename, std::ios::binary);
+    TTFileHeader  header = tt_file_header(clusterCount, generation8, epoch8);
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(table),
+                 std::streamsize(clusterCount * sizeof(Cluster)));
+
+    return bool(stream);
+}
+
+
+// Restores a table written by save(), including its generation. Shared
+// tables can not be loaded into, and the dump must have the size of the
+// current table, so that the memory and placement chosen by the options stay
+// in effect. The clusters are read straight into the table. A file with a
+// mismatching header leaves the table untouched, while a truncated one leaves
+// it empty.
+bool TranspositionTable::load(const std::string& filename, ThreadPool& threads) {
+
+    std::ifstream stream(filename, std::ios::binary);
+    TTFileHeader  header;
+
+    if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+
+    TTFileHeader expected =
+      tt_file_header(header.clusterCount, uint8_t(header.generation8), uint8_t(header.epoch8));
+
+    if (std::memcmp(&header, &expected, sizeof(header)) || !header.clusterCount || sharedHeader)
+        return false;
+
+    if (header.clusterCount != clusterCount)
+    {
+        std::cerr << "Hash file " << filename << " holds a "
+                  << header.clusterCount * sizeof(Cluster) / (1024 * 1024)
+                  << "MB transposition table, the current one has "
+                  << clusterCount * sizeof(Cluster) / (1024 * 1024) << "MB." << std::endl;
+        return false;
+    }
+
+    stop_clearing();
+
+    generation8 = uint8_t(header.generation8);
+    epoch8      = uint8_t(header.epoch8);
+
+    bool loaded = bool(stream.read(reinterpret_cast<char*>(table),
+                                   std::streamsize(clusterCount * sizeof(Cluster))));
+
+    if (!loaded)
+        clear(threads);
+    else
+        start_clearing(threads, false, false);
+
+    return loaded;
+}
+
+
+// A shared table starts with this header, followed by the Cluster array at
+// TTSharedHeaderSize bytes. The layout is checked by every process attaching,
+// and the generation is advanced by all of them so that entries age with the
+// searches of any process.
+struct TTSharedHeader {
+    TTFileHeader         layout;  // As for saved tables, with zero generation and epoch
+    std::atomic<uint8_t> generation8;
+};
+
+static constexpr size_t TTSharedHeaderSize = 4096;
+
+static_assert(sizeof(TTSharedHeader) <= TTSharedHeaderSize);
+
+
+// Maps the table to the named shared memory segment, creating it with the
+// requested size if needed. An existing segment keeps its own size.
+bool TranspositionTable::attach_shared(size_t mbSize, const std::string& name) {
+
+    size_t size = TTSharedHeaderSize + mbSize * 1024 * 1024 / sizeof(Cluster) * sizeof(Cluster);
+    bool   created;
+    void*  mem = shared_memory_attach(name, size, created);
+
+    if (!mem)
+        return false;
+
+    auto*        header = static_cast<TTSharedHeader*>(mem);
+    const size_t count  = size > TTSharedHeaderSize ? (size - TTSharedHeaderSize) / sizeof(Cluster) : 0;
+    TTFileHeader layout = tt_file_header(count, 0, 0);
+
+    // A new segment is zero filled, so all of its clusters are empty at epoch 0
+    if (created)
+        new (header) TTSharedHeader{layout, {0}};
+
+    else if (!count || std::memcmp(&header->layout, &layout, sizeof(layout)))
+    {
+        shared_memory_detach(mem, size);
+        return false;
+    }
+
+    sharedHeader = header;
+    sharedSize   = size;
+    clusterCount = count;
+    table        = reinterpret_cast<Cluster*>(static_cast<char*>(mem) + TTSharedHeaderSize);
+    generation8  = header->generation8;
+    epoch8       = 0;
+
+    return true;
+}
+
+
+void TranspositionTable::free_table() {
+
+    if (sharedHeader)
+        shared_memory_detach(sharedHeader, sharedSize);
+    else
+        aligned_large_pages_free(table);
+
+    table        = nullptr;
+    sharedHeader = nullptr;
 }
 
 
@@ -200,7 +712,7 @@ int TranspositionTable::hashfull(int maxAge) const {
     int cnt            = 0;
     for (int i = 0; i < 1000; ++i)
         for (int j = 0; j < ClusterSize; ++j)
-            cnt += table[i].entry[j].is_occupied()
+            cnt += table[i].epoch8 == epoch8 && table[i].entry[j].is_occupied()
                 && table[i].entry[j].relative_age(generation8) <= maxAgeInternal;
 
     return cnt / ClusterSize;
@@ -209,40 +721,137 @@ int TranspositionTable::hashfull(int maxAge) const {
 
 void TranspositionTable::new_search() {
     // increment by delta to keep lower bits as is
-    generation8 += GENERATION_DELTA;
+    if (sharedHeader)
+        generation8 = sharedHeader->generation8.fetch_add(GENERATION_DELTA) + GENERATION_DELTA;
+    else
+        generation8 += GENERATION_DELTA;
 }
 
 
 uint8_t TranspositionTable::generation() const { return generation8; }
 
 
-// Looks up the current position in the transposition
-// table. It returns true if the position is found.
-// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
-// to be replaced later. The replace value of an entry is calculated as its depth
-// minus 8 times its relative age. TTEntry t1 is considered more valuable than
-// TTEntry t2 if its replace value is greater than that of t2.
-std::tuple<bool, TTData, TTWriter> TranspositionTable::probe(const Key key) const {
+// Returns the entry of the cluster holding the key if any, otherwise the least
+// valuable entry according to the replacement strategy.
+TTEntry* TranspositionTable::find_entry(Cluster* cl, const Key key, uint8_t generation8) {
 
-    TTEntry* const tte   = first_entry(key);
+    TTEntry* const tte   = cl->entry;
     const uint16_t key16 = uint16_t(key);  // Use the low 16 bits as key inside the cluster
 
     for (int i = 0; i < ClusterSize; ++i)
         if (tte[i].key16 == key16)
-            // This gap is the main place for read races.
-            // After `read()` completes that copy is final, but may be self-inconsistent.
-            return {tte[i].is_occupied(), tte[i].read(), TTWriter(&tte[i])};
+            return &tte[i];
 
-    // Find an entry to be replaced according to the replacement strategy
     TTEntry* replace = tte;
     for (int i = 1; i < ClusterSize; ++i)
         if (replace->depth8 - replace->relative_age(generation8)
             > tte[i].depth8 - tte[i].relative_age(generation8))
             replace = &tte[i];
 
+    return replace;
+}
+
+
+// Looks up the current position in the transposition
+// table. It returns true if the position is found.
+// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
+// to be replaced later. The replace value of an entry is calculated as its depth
+// minus 8 times its relative age. TTEntry t1 is considered more valuable than
+// TTEntry t2 if its replace value is greater than that of t2. With node tables,
+// the table of the node of the calling thread is probed first, so that
+// positions only searched shallowly never reach the global table. With a
+// deferred table bound, it replaces the node tables, see probe_deferred().
+std::tuple<bool, TTData, TTWriter> TranspositionTable::probe(const Key key) const {
+
+    if constexpr (TTStatsEnabled)
+        if (threadStats)
+            ++threadStats->probes;
+
+    if (threadDeferredTable)
+        return probe_deferred(key);
+
+    TTEntry* nodeEntry = nullptr;
+
+    if (threadNodeTable)
+    {
+        Cluster* const nodeCl = &threadNodeTable->table[mul_hi64(key, threadNodeTable->clusterCount)];
+
+        // Reset clusters left over from before the last clear()
+        if (nodeCl->epoch8 != nodeEpoch8)
+            nodeCl->reset(nodeEpoch8);
+
+        nodeEntry = find_entry(nodeCl, key, generation8);
+
+        if (nodeEntry->key16 == uint16_t(key) && nodeEntry->is_occupied())
+        {
+            if constexpr (TTStatsEnabled)
+                if (threadStats)
+                    ++threadStats->hits;
+
+            return {true, nodeEntry->read(), TTWriter(nullptr, nodeEntry, this)};
+        }
+    }
+
+    auto result = probe_global(key);
+
+    if (!std::get<0>(result))
+        std::get<2>(result).nodeEntry = nodeEntry;
+
+    else if constexpr (TTStatsEnabled)
+        if (threadStats)
+            ++threadStats->hits;
+
+    return result;
+}
+
+
+// Probes the global table only, see probe()
+std::tuple<bool, TTData, TTWriter> TranspositionTable::probe_global(const Key key) const {
+
+    Cluster* const cl = &table[mul_hi64(key, clusterCount)];
+
+    // Reset clusters left over from before the last clear()
+    if (cl->epoch8 != epoch8)
+        cl->reset(epoch8);
+
+    TTEntry* const tte = find_entry(cl, key, generation8);
+
+    if (tte->key16 == uint16_t(key))
+        // This gap is the main place for read races.
+        // After `read()` completes that copy is final, but may be self-inconsistent.
+        return {tte->is_occupied(), tte->read(), TTWriter(tte, nullptr, this)};
+
     return {false,
             TTData{Move::none(), VALUE_NONE, VALUE_NONE, DEPTH_ENTRY_OFFSET, BOUND_NONE, false},
-            TTWriter(replace)};
+            TTWriter(tte, nullptr, this)};
+}
+
+
+// Probes the deferred table of the calling thread, then the global table, which
+// is not written to during an iteration. Writes always go to the deferred table.
+std::tuple<bool, TTData, TTWriter> TranspositionTable::probe_deferred(const Key key) const {
+
+    const size_t   index = mul_hi64(key, threadDeferredTable->clusterCount);
+    Cluster* const cl    = &threadDeferredTable->table[index];
+    TTEntry* const tte   = find_entry(cl, key, generation8);
+    Key* const     slot  = &threadDeferredTable->keys[index * ClusterSize + (tte - cl->entry)];
+
+    if (tte->key16 == uint16_t(key) && tte->is_occupied())
+    {
+        if constexpr (TTStatsEnabled)
+            if (threadStats)
+                ++threadStats->hits;
+
+        return {true, tte->read(), TTWriter(tte, nullptr, this, slot)};
+    }
+
+    auto [found, data, writer] = probe_global(key);
+
+    if constexpr (TTStatsEnabled)
+        if (found && threadStats)
+            ++threadStats->hits;
+
+    return {found, data, TTWriter(tte, nullptr, this, slot)};
 }
 
 
@@ -250,4 +859,176 @@ TTEntry* TranspositionTable::first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
 }
 
+
+TTNodeTable::TTNodeTable(size_t count) :
+    clusterCount(count),
+    table(static_cast<Cluster*>(aligned_large_pages_alloc(count * sizeof(Cluster)))) {
+
+    if (!table)
+    {
+        std::cerr << "Failed to allocate a NUMA node transposition table." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::memset(static_cast<void*>(table), 0, count * sizeof(Cluster));
+}
+
+TTNodeTable::~TTNodeTable() { aligned_large_pages_free(table); }
+
+
+TTNodeTables::TTNodeTables(NumaReplicationContext& ctx, size_t count) :
+    NumaReplicatedBase(ctx),
+    clusterCount(count) {
+    allocate();
+}
+
+const TTNodeTable& TTNodeTables::operator[](NumaReplicatedAccessToken token) const {
+    assert(token.get_numa_index() < tables.size());
+    return *tables[token.get_numa_index()];
+}
+
+const TTNodeTable* TTNodeTables::of_node(NumaIndex n) const {
+    return n < tables.size() ? tables[n].get() : nullptr;
+}
+
+// The entries are dropped, as they may belong to another node now
+void TTNodeTables::on_numa_config_changed() { allocate(); }
+
+// Allocates one table per node from a thread of that node, which also zeroes
+// it, so that its pages are backed by the memory of that node
+void TTNodeTables::allocate() {
+
+    tables.clear();
+
+    const NumaConfig& cfg = get_numa_config();
+
+    if (cfg.requires_memory_replication())
+        for (NumaIndex n = 0; n < cfg.num_numa_nodes(); ++n)
+            cfg.execute_on_numa_node(
+              n, [this]() { tables.emplace_back(std::make_unique<TTNodeTable>(clusterCount)); });
+    else
+        tables.emplace_back(std::make_unique<TTNodeTable>(clusterCount));
+}
+
+
+// Makes the TT two-level, with in addition to the global table one table of
+// mbSize MB per NUMA node, holding the entries shallower than NodeTableMaxDepth.
+// Shallow searches are the bulk of TT traffic, which then stays within the node
+// of the searching thread. Must be called after resize(), which stops any
+// background clearing of the old node tables.
+void TranspositionTable::resize_node_tables(NumaReplicationContext& context, size_t mbSize) {
+
+    nodeTables.reset();
+    nodeEpoch8 = 0;
+
+    if (mbSize)
+        nodeTables =
+          std::make_unique<TTNodeTables>(context, mbSize * 1024 * 1024 / sizeof(Cluster));
+}
+
+
+// Selects the node table used by probe() on the calling thread, following the
+// NUMA binding of the thread. Must be called again whenever the tables change.
+void TranspositionTable::bind_node_table(NumaReplicatedAccessToken token) const {
+    threadNodeTable = nodeTables ? &(*nodeTables)[token] : nullptr;
+}
+
+
+TTDeferredTable::TTDeferredTable(size_t mbSize) :
+    sizeMb(mbSize),
+    clusterCount(mbSize * 1024 * 1024 / (sizeof(Cluster) + ClusterSize * sizeof(Key))),
+    table(static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)))),
+    keys(std::make_unique<Key[]>(clusterCount * ClusterSize)) {
+
+    if (!table)
+    {
+        std::cerr << "Failed to allocate a deferred transposition table." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    clear();
+}
+
+TTDeferredTable::~TTDeferredTable() { aligned_large_pages_free(table); }
+
+void TTDeferredTable::clear() {
+    std::memset(static_cast<void*>(table), 0, clusterCount * sizeof(Cluster));
+}
+
+
+// Makes probe() on the calling thread read through the given deferred table
+// and write only to it, or restores normal probing if nullptr.
+void TranspositionTable::bind_deferred_table(TTDeferredTable* deferred) {
+    threadDeferredTable = deferred;
+}
+
+
+// Writes the entries of a deferred table to the global table, as if they had
+// been written there in the first place, and empties the deferred table. The
+// entries are replayed in table order, so the result does not depend on timing.
+void TranspositionTable::apply_deferred(TTDeferredTable& deferred) {
+
+    for (size_t i = 0; i < deferred.clusterCount; ++i)
+        for (int j = 0; j < ClusterSize; ++j)
+        {
+            const TTEntry& tte = deferred.table[i].entry[j];
+
+            if (!tte.is_occupied())
+                continue;
+
+            const TTData data = tte.read();
+            std::get<2>(probe_global(deferred.keys[i * ClusterSize + j]))
+              .entry->save(deferred.keys[i * ClusterSize + j], data.value, data.is_pv, data.bound,
+                           data.depth, data.move, data.eval, generation8);
+        }
+
+    deferred.clear();
+}
+
+
+// Makes probe() and TTEntry::save() on the calling thread update the given
+// counters, or none if nullptr. Only has an effect in builds with ttstats=yes.
+void TranspositionTable::bind_stats(TTStats* stats) { threadStats = stats; }
+
+
+// Returns, for each possible number of used entries in a cluster, how many
+// clusters have that many. Only a sample at the start of the table is scanned,
+// as in hashfull().
+std::vector<uint64_t> TranspositionTable::fill_distribution() const {
+
+    std::vector<uint64_t> fill(ClusterSize + 1);
+    const size_t          sampleSize = std::min(clusterCount, size_t(1) << 20);
+
+    for (size_t i = 0; i < sampleSize; ++i)
+    {
+        int used = 0;
+
+        if (table[i].epoch8 == epoch8)
+            for (const TTEntry& e : table[i].entry)
+                used += e.is_occupied();
+
+        ++fill[used];
+    }
+
+    return fill;
+}
+
+
+// Returns the NUMA node of the pages holding samples clusters evenly spread
+// over the table, -1 where unknown.
+std::vector<int> TranspositionTable::page_nodes(size_t samples) const {
+
+    std::vector<const void*> addresses;
+
+    for (size_t i = 0; i < samples && clusterCount; ++i)
+        addresses.push_back(&table[mul_div(i, clusterCount, samples, false)]);
+
+    return memory_page_nodes(addresses);
+}
+
+
+std::string TranspositionTable::large_pages_info() const {
+    return sharedHeader ? "shared" : Hypnos::large_pages_info(table);
+}
+
 }  // namespace Hypnos
@@ -19,18 +19,25 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <string>
 #include <tuple>
+#include <vector>
 
 #include "memory.h"
+#include "numa.h"
 #include "types.h"
 
 namespace Hypnos {
 
 class ThreadPool;
+class TranspositionTable;
 struct TTEntry;
 struct Cluster;
+struct TTSharedHeader;
 
 // There is only one global hash table for the engine and all its threads. For chess in particular, we even allow racy
 // updates between threads to and from the TT, as taking the time to synchronize access would cost thinking time and
@@ -44,6 +51,46 @@ struct Cluster;
 // The copied data and the writer are separated to maintain clear boundaries between local vs global objects.
 
 
+#ifdef TT_STATS
+constexpr bool TTStatsEnabled = true;
+#else
+constexpr bool TTStatsEnabled = false;
+#endif
+
+// Counters of the TT behaviour, only updated in builds with ttstats=yes. Each
+// search thread owns one and binds it with TranspositionTable::bind_stats(),
+// so that counting does not contend between threads.
+struct TTStats {
+    uint64_t probes            = 0;
+    uint64_t hits              = 0;
+    uint64_t falseMatches      = 0;  // Hits whose stored move is not even pseudo-legal
+    uint64_t ageReplacements   = 0;  // Other positions overwritten for being from an older search
+    uint64_t depthReplacements = 0;  // Other positions of the current search overwritten
+    uint64_t depthDecrements   = 0;  // Writes refused, only aging the entry by one ply
+    uint64_t firstWrites       = 0;  // Writes of a position not in its entry yet
+
+    TTStats& operator+=(const TTStats& other) {
+        probes += other.probes;
+        hits += other.hits;
+        falseMatches += other.falseMatches;
+        ageReplacements += other.ageReplacements;
+        depthReplacements += other.depthReplacements;
+        depthDecrements += other.depthDecrements;
+        firstWrites += other.firstWrites;
+        return *this;
+    }
+};
+
+
+// How the pages of a private table are spread over the NUMA nodes the threads
+// are bound to, see TranspositionTable::start_clearing()
+enum class TTPlacement {
+    System,      // Contiguous portions, one per thread in pool order
+    Interleave,  // Round robin over the nodes, by large page
+    Partition    // Contiguous portions, one per node, sized by its thread count
+};
+
+
 // A copy of the data already in the entry (possibly collided). `probe` may be racy, resulting in inconsistent data.
 struct TTData {
     Move  move;
@@ -66,25 +113,96 @@ struct TTData {
 };
 
 
-// This is used to make racy writes to the global TT.
+// This is used to make racy writes to the global TT. With node tables, it also
+// decides by depth which of the two tables receives the data.
 struct TTWriter {
    public:
     void write(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8);
 
    private:
     friend class TranspositionTable;
-    TTEntry* entry;
-    TTWriter(TTEntry* tte);
+    TTEntry*                  entry;      // Global entry, nullptr if not probed
+    TTEntry*                  nodeEntry;  // Entry in the node table, if any
+    const TranspositionTable* tt;
+    Key*                      fullKey;  // Key slot of a deferred table entry, if any
+    TTWriter(TTEntry*                  tte,
+             TTEntry*                  nodeTte,
+             const TranspositionTable* table,
+             Key*                      keySlot = nullptr);
+};
+
+
+// The table of one NUMA node when the TT has two levels, holding the shallow
+// entries, see TranspositionTable::resize_node_tables()
+struct TTNodeTable {
+    explicit TTNodeTable(size_t count);
+    TTNodeTable(const TTNodeTable&)            = delete;
+    TTNodeTable& operator=(const TTNodeTable&) = delete;
+    ~TTNodeTable();
+
+    size_t   clusterCount;
+    Cluster* table;
+};
+
+
+// The node tables, one per NUMA node, each allocated by a thread of its node.
+// Unlike NumaReplicated, which copies one object to every node, they are built
+// from their size, as their entries are never shared between nodes.
+class TTNodeTables: public NumaReplicatedBase {
+   public:
+    TTNodeTables(NumaReplicationContext& ctx, size_t count);
+
+    const TTNodeTable& operator[](NumaReplicatedAccessToken token) const;
+    const TTNodeTable* of_node(NumaIndex n) const;  // nullptr if the node has no table
+
+    void on_numa_config_changed() override;
+
+   private:
+    void allocate();
+
+    size_t                                    clusterCount;
+    std::vector<std::unique_ptr<TTNodeTable>> tables;
+};
+
+
+// The entries written by one thread during an iteration of the deterministic
+// multi-threaded search, held back from the global table until all the threads
+// have finished the iteration, see TranspositionTable::apply_deferred(). The
+// full key of each entry is kept so that the writes can be replayed.
+struct TTDeferredTable {
+    explicit TTDeferredTable(size_t mbSize);
+    TTDeferredTable(const TTDeferredTable&)            = delete;
+    TTDeferredTable& operator=(const TTDeferredTable&) = delete;
+    ~TTDeferredTable();
+
+    void clear();
+
+    size_t                 sizeMb, clusterCount;
+    Cluster*               table;
+    std::unique_ptr<Key[]> keys;
 };
 
 
 class TranspositionTable {
 
    public:
-    ~TranspositionTable() { aligned_large_pages_free(table); }
+    ~TranspositionTable() {
+        stop_clearing();
+        free_table();
+    }
 
-    void resize(size_t mbSize, ThreadPool& threads);  // Set TT size
-    void clear(ThreadPool& threads);                  // Re-initialize memory, multithreaded
+    // Set TT size, or attach to the shared table of that name if not empty
+    void resize(size_t             mbSize,
+                ThreadPool&        threads,
+                bool               preserve,
+                const std::string& sharedName,
+                TTPlacement        placement,
+                bool               hugeTLB);
+    void clear(ThreadPool& threads);  // Empty the table, zeroing memory in the background
+    void stop_clearing();             // Abort the background zeroing, if any
+    void finish_clearing();           // Wait for the background zeroing to complete
+    bool save(const std::string& filename);  // Dump the table and its generation to a file
+    bool load(const std::string& filename, ThreadPool& threads);  // Restore a saved table
     int  hashfull(int maxAge = 0)
       const;  // Approximate what fraction of entries (permille) have been written to during this root search
 
@@ -96,13 +214,50 @@ class TranspositionTable {
     TTEntry* first_entry(const Key key)
       const;  // This is the hash function; its only external use is memory prefetching.
 
+    void resize_node_tables(NumaReplicationContext& context, size_t mbSize);  // 0 to disable
+    void bind_node_table(NumaReplicatedAccessToken token) const;  // Table used by the calling thread
+
+    static void bind_stats(TTStats* stats);  // Counters updated by the calling thread
+    static void bind_deferred_table(TTDeferredTable* deferred);  // Writes held back, or nullptr
+    void        apply_deferred(TTDeferredTable& deferred);  // Replay the held back writes
+    std::vector<uint64_t> fill_distribution() const;  // Number of clusters per count of used entries
+    std::vector<int>      page_nodes(size_t samples) const;  // NUMA nodes of sampled table pages
+    std::string           large_pages_info() const;  // Page size backing the table
+
    private:
     friend struct TTEntry;
+    friend struct TTWriter;
 
-    size_t   clusterCount;
-    Cluster* table = nullptr;
+    void start_clearing(ThreadPool& threads, bool all, bool withNodeTables);
+    void free_table();
+    std::tuple<bool, TTData, TTWriter> probe_global(const Key key) const;
+    std::tuple<bool, TTData, TTWriter> probe_deferred(const Key key) const;
+    static TTEntry* find_entry(Cluster* cl, const Key key, uint8_t generation8);
+    bool attach_shared(size_t mbSize, const std::string& name);
+    void migrate(const Cluster* oldTable, size_t oldCount, ThreadPool& threads);
+
+    size_t      clusterCount;
+    Cluster*    table     = nullptr;
+    bool        hugeTLB   = false;  // Whether the table is allocated from explicit huge pages
+    TTPlacement placement = TTPlacement::System;
 
     uint8_t generation8 = 0;  // Size must be not bigger than TTEntry::genBound8
+
+    // Bumped by clear(). Clusters tagged with an older epoch are stale and read
+    // as empty, while the threads of the pool reset them in the background.
+    uint8_t           epoch8       = 0;
+    ThreadPool*       clearThreads = nullptr;  // Set while the threads are zeroing
+    std::atomic<bool> abortClear{false};
+
+    // Set when the table lives in a shared memory segment, see attach_shared()
+    TTSharedHeader* sharedHeader = nullptr;
+    size_t          sharedSize   = 0;
+
+    // One table per NUMA node for the shallow entries, see resize_node_tables().
+    // Their clusters are tagged with their own epoch, as clear() leaves the epoch
+    // of a shared table alone.
+    std::unique_ptr<TTNodeTables> nodeTables;
+    uint8_t                       nodeEpoch8 = 0;
 };
 
 }  // namespace Hypnos
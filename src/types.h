@@ -207,6 +207,11 @@ constexpr Value PieceValue[PIECE_NB] = {
   VALUE_ZERO, PawnValue, KnightValue, BishopValue, RookValue, QueenValue, VALUE_ZERO, VALUE_ZERO,
   VALUE_ZERO, PawnValue, KnightValue, BishopValue, RookValue, QueenValue, VALUE_ZERO, VALUE_ZERO};
 
+// Contribution of each piece to the game phase, which sums up to 24 in the
+// starting position and decreases as pieces are traded.
+constexpr int PhaseWeight[PIECE_NB] = {0, 0, 1, 1, 2, 4, 0, 0,  //
+                                       0, 0, 1, 1, 2, 4, 0, 0};
+
 using Depth = int;
 
 // The following DEPTH_ constants are used for transposition table entries
@@ -22,6 +22,7 @@
 #include <cctype>
 #include <cmath>
 #include <cstdint>
+#include <iomanip>
 #include <iterator>
 #include <optional>
 #include <sstream>
@@ -110,7 +111,10 @@ void UCIEngine::loop() {
         // has played. The search should continue, but should also switch from pondering
         // to the normal search.
         else if (token == "ponderhit")
+        {
             engine.set_ponderhit(false);
+            print_ponder_stats();
+        }
 
         else if (token == "uci")
         {
@@ -142,6 +146,10 @@ void UCIEngine::loop() {
             engine.flip();
         else if (token == "bench")
             bench(is);
+        else if (token == "scaling")
+            scaling(is);
+        else if (token == "perftsuite")
+            perft_suite(is);
         else if (token == BenchmarkCommand)
             benchmark(is);
         else if (token == "d")
@@ -162,6 +170,24 @@ void UCIEngine::loop() {
 
             engine.save_network(files);
         }
+        else if (token == "tt")
+        {
+            if (is >> std::skipws >> token && token == "stats")
+                sync_cout << engine.tt_stats_information_as_string() << sync_endl;
+            else
+                sync_cout << "Unknown command: '" << cmd << "'." << sync_endl;
+        }
+        else if (token == "savehash" || token == "loadhash")
+        {
+            std::string file;
+
+            if (!(is >> std::skipws >> file))
+                sync_cout << "No file specified for " << token << sync_endl;
+            else if (token == "savehash")
+                engine.save_tt(file);
+            else
+                engine.load_tt(file);
+        }
         else if (token == "--help" || token == "help" || token == "--license" || token == "license")
             sync_cout
               << "\nHypnos is a powerful chess engine for playing and analyzing."
@@ -224,7 +250,15 @@ void UCIEngine::go(std::istringstream& is) {
     if (limits.perft)
         perft(limits);
     else
+    {
         engine.go(limits);
+        print_ponder_stats();
+    }
+}
+
+void UCIEngine::print_ponder_stats() {
+    if (auto stats = engine.ponder_stats_information_as_string())
+        print_info_string(*stats);
 }
 
 void UCIEngine::bench(std::istream& args) {
@@ -287,10 +321,22 @@ void UCIEngine::bench(std::istream& args) {
 
     dbg_print();
 
-    std::cerr << "\n==========================="    //
-              << "\nTotal time (ms) : " << elapsed  //
-              << "\nNodes searched  : " << nodes    //
-              << "\nNodes/second    : " << 1000 * nodes / elapsed << std::endl;
+    Eval::EvalStats evalStats = engine.get_eval_stats();
+
+    std::cerr << "\n==========================="                //
+              << "\nTotal time (ms) : " << elapsed              //
+              << "\nNodes searched  : " << nodes                //
+              << "\nNodes/second    : " << 1000 * nodes / elapsed  //
+              << "\nSmall net evals : " << evalStats.smallNet    //
+              << "\nBig net fallback: " << evalStats.fallbacks << " ("
+              << 100.0 * evalStats.fallbacks / std::max<uint64_t>(evalStats.smallNet, 1) << "%)"
+              << "\nEval cache hits : " << evalStats.cacheHits << " ("
+              << 100.0 * evalStats.cacheHits
+                   / std::max<uint64_t>(evalStats.cacheHits + evalStats.cacheMisses, 1)
+              << "%)" << std::endl;
+
+    if (Search::TreeStatsEnabled)
+        std::cerr << engine.tree_stats_information_as_string() << std::endl;
 
     // reset callback, to not capture a dangling reference to nodesSearched
     engine.set_on_update_full([&](const auto& i) { on_update_full(i, options["UCI_ShowWDL"]); });
@@ -427,6 +473,8 @@ void UCIEngine::benchmark(std::istream& args) {
       std::size(hashfullAges) == 2 && hashfullAges[0] == 0 && hashfullAges[1] == 999,
       "Hardcoded for display. Would complicate the code needlessly in the current state.");
 
+    Eval::EvalStats evalStats = engine.get_eval_stats();
+
     std::string threadBinding = engine.thread_binding_information_as_string();
     if (threadBinding.empty())
         threadBinding = "none";
@@ -438,7 +486,7 @@ void UCIEngine::benchmark(std::istream& args) {
               << engine_version_info()
               // "\nCompiled by                : "
               << compiler_info()
-              << "Large pages                : " << (has_large_pages() ? "yes" : "no")
+              << "Large pages                : " << engine.large_pages_information_as_string()
               << "\nUser invocation            : " << BenchmarkCommand << " "
               << setup.originalInvocation << "\nFilled invocation          : " << BenchmarkCommand
               << " " << setup.filledInvocation
@@ -453,21 +501,151 @@ void UCIEngine::benchmark(std::istream& args) {
               << totalHashfull[1] / numHashfullReadings
               << "\nTotal nodes searched       : " << nodes
               << "\nTotal search time [s]      : " << totalTime / 1000.0
-              << "\nNodes/second               : " << 1000 * nodes / totalTime << std::endl;
+              << "\nNodes/second               : " << 1000 * nodes / totalTime
+              << "\nSmall net evals            : " << evalStats.smallNet
+              << "\nBig net fallbacks          : " << evalStats.fallbacks << " ("
+              << 100.0 * evalStats.fallbacks / std::max<uint64_t>(evalStats.smallNet, 1) << "%)"
+              << "\nEval cache hits            : " << evalStats.cacheHits << " ("
+              << 100.0 * evalStats.cacheHits
+                   / std::max<uint64_t>(evalStats.cacheHits + evalStats.cacheMisses, 1)
+              << "%)" << std::endl;
+
+    std::cerr << engine.tt_placement_information_as_string() << std::endl;
+
+    if (TTStatsEnabled)
+        std::cerr << engine.tt_stats_information_as_string() << std::endl;
 
     // clang-format on
 
     init_search_update_listeners();
 }
 
+// Runs the bench positions with 1, 2, 4, ... and finally maxThreads threads,
+// reporting the time to reach the bench depth for each thread count. With
+// ttstats=yes, it also reports the share of nodes writing a position to the TT
+// for the first time, which drops as threads duplicate each other's work.
+// Arguments are maxThreads, TT size, depth and FEN file, as for bench.
+void UCIEngine::scaling(std::istream& args) {
+    std::string token;
+    uint64_t    nodesSearched = 0;
+
+    const int   maxThreads = (args >> token) ? std::stoi(token) : int(get_hardware_concurrency());
+    std::string ttSize     = (args >> token) ? token : "64";
+    std::string depth      = (args >> token) ? token : "11";
+    std::string fenFile    = (args >> token) ? token : "default";
+
+    engine.set_on_update_full([&](const Engine::InfoFull& i) { nodesSearched = i.nodes; });
+    engine.set_on_iter([](const auto&) {});
+    engine.set_on_update_no_moves([](const auto&) {});
+    engine.set_on_bestmove([](const auto&, const auto&) {});
+    engine.set_on_verify_networks([](const auto&) {});
+
+    std::cerr << "\nThreads  Time [ms]  Speedup  Nodes/second  Unique nodes [%]" << std::endl;
+
+    TimePoint singleThreadTime = 0;
+
+    for (int threads = 1;; threads = std::min(2 * threads, maxThreads))
+    {
+        std::istringstream ss(ttSize + " " + std::to_string(threads) + " " + depth + " " + fenFile);
+        TimePoint          elapsed = 0;
+        uint64_t           nodes   = 0;
+
+        for (const auto& cmd : Benchmark::setup_bench(engine.fen(), ss))
+        {
+            std::istringstream is(cmd);
+            is >> std::skipws >> token;
+
+            if (token == "go")
+            {
+                Search::LimitsType limits = parse_limits(is);
+                TimePoint          start  = now();
+
+                engine.go(limits);
+                engine.wait_for_search_finished();
+
+                elapsed += now() - start;
+                nodes += nodesSearched;
+            }
+            else if (token == "setoption")
+                setoption(is);
+            else if (token == "position")
+                position(is);
+            else if (token == "ucinewgame")
+                engine.search_clear();
+        }
+
+        elapsed          = std::max<TimePoint>(elapsed, 1);
+        singleThreadTime = threads == 1 ? elapsed : singleThreadTime;
+
+        std::cerr << std::setw(7) << threads << std::setw(11) << elapsed << std::setw(9)
+                  << std::fixed << std::setprecision(2) << double(singleThreadTime) / elapsed
+                  << std::setw(14) << 1000 * nodes / elapsed << std::setw(18);
+
+        if (TTStatsEnabled)
+            std::cerr << 100.0 * engine.get_tt_stats().firstWrites / std::max<uint64_t>(nodes, 1);
+        else
+            std::cerr << "n/a";
+
+        std::cerr << std::endl;
+
+        if (threads >= maxThreads)
+            break;
+    }
+
+    init_search_update_listeners();
+}
+
+// Runs perft on the positions of an EPD file, annotated with their expected
+// counts as ";D1 20 ;D2 400 ...", and reports the counts that differ. Arguments
+// are the file name and an optional maximum depth, 0 for all annotated depths.
+// The positions are counted in parallel with the current Threads and Hash.
+void UCIEngine::perft_suite(std::istream& args) {
+    std::string token;
+
+    const std::string epdFile  = (args >> token) ? token : "";
+    const int         maxDepth = (args >> token) ? std::stoi(token) : 0;
+
+    auto suite = Benchmark::setup_perft_suite(epdFile, maxDepth,
+                                              engine.get_options()["UCI_Chess960"]);
+
+    if (suite.empty())
+        return;
+
+    engine.wait_for_search_finished();
+
+    TimePoint elapsed = now();
+    uint64_t  nodes   = engine.perft_suite(suite);
+    elapsed           = now() - elapsed + 1;  // Ensure positivity to avoid a 'divide by zero'
+
+    size_t mismatches = 0;
+
+    for (const auto& pc : suite)
+        for (size_t i = 0; i < pc.expected.size(); ++i)
+            if (pc.counted[i] != pc.expected[i].second)
+            {
+                ++mismatches;
+                sync_cout << "Mismatch at depth " << pc.expected[i].first << ": expected "
+                          << pc.expected[i].second << ", counted " << pc.counted[i]
+                          << "\n  fen " << pc.fen << sync_endl;
+            }
+
+    sync_cout << "\nPositions: " << suite.size() << "\nMismatches: " << mismatches
+              << "\nNodes searched: " << nodes << "\nNodes/second: " << 1000 * nodes / elapsed
+              << "\n" << sync_endl;
+}
+
 void UCIEngine::setoption(std::istringstream& is) {
     engine.wait_for_search_finished();
     engine.get_options().setoption(is);
 }
 
 std::uint64_t UCIEngine::perft(const Search::LimitsType& limits) {
+    TimePoint elapsed = now();
     auto nodes = engine.perft(engine.fen(), limits.perft, engine.get_options()["UCI_Chess960"]);
-    sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+    elapsed    = now() - elapsed + 1;  // Ensure positivity to avoid a 'divide by zero'
+
+    sync_cout << "\nNodes searched: " << nodes << "\nNodes/second: " << 1000 * nodes / elapsed
+              << "\n" << sync_endl;
     return nodes;
 }
 
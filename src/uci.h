@@ -63,6 +63,9 @@ class UCIEngine {
     void          go(std::istringstream& is);
     void          bench(std::istream& args);
     void          benchmark(std::istream& args);
+    void          scaling(std::istream& args);
+    void          perft_suite(std::istream& args);
+    void          print_ponder_stats();
     void          position(std::istringstream& is);
     void          setoption(std::istringstream& is);
     std::uint64_t perft(const Search::LimitsType&);
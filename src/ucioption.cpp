@@ -23,6 +23,7 @@
 #include <cctype>
 #include <cstdlib>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <utility>
 
@@ -133,7 +134,7 @@ Option::operator int() const {
 }
 
 Option::operator std::string() const {
-    assert(type == "string");
+    assert(type == "string" || type == "combo");
     return currentValue;
 }
 
@@ -159,12 +160,12 @@ Option& Option::operator=(const std::string& v) {
 
     if (type == "combo")
     {
-        OptionsMap         comboMap;  // To have case insensitive compare
-        std::string        token;
-        std::istringstream ss(defaultValue);
+        std::set<std::string, CaseInsensitiveLess> comboValues;  // Case insensitive compare
+        std::string                                token;
+        std::istringstream                         ss(defaultValue);
         while (ss >> token)
-            comboMap.add(token, Option());
-        if (!comboMap.count(v) || v == "var")
+            comboValues.insert(token);
+        if (!comboValues.count(v) || v == "var")
             return *this;
     }
 
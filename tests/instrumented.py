@@ -368,6 +368,15 @@ class TestInteractive(metaclass=OrderedClassMembers):
         self.stockfish.expect("* score mate 1 * pv f7f5")
         self.stockfish.starts_with("bestmove f7f5")
 
+    def test_fen_position_perft_captures_and_promotions(self):
+        # Debug builds also check the incremental game phase at every node
+        self.stockfish.send_command("ucinewgame")
+        self.stockfish.send_command(
+            "position fen rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"
+        )
+        self.stockfish.send_command("go perft 3")
+        self.stockfish.expect("Nodes searched: 62379")
+
     def test_fen_position_with_mate_go_depth_and_searchmoves(self):
         self.stockfish.send_command("ucinewgame")
         self.stockfish.send_command(
@@ -412,6 +421,43 @@ class TestInteractive(metaclass=OrderedClassMembers):
 
         self.stockfish.send_command("setoption name Skill Level value 20")
 
+    def test_ponder_candidates_high_rule50(self):
+        # Past the rule50 count where Position::key() changes, the other reply
+        # must still be pondered on and recognized when it is played
+        fen = "position fen 7k/8/8/5K2/8/8/8/R7 w - - 60 100"
+
+        self.stockfish.send_command("setoption name Threads value 2")
+        self.stockfish.send_command("setoption name Ponder Candidates value 2")
+        self.stockfish.send_command(fen)
+        self.stockfish.send_command("go depth 8 searchmoves a1a8")
+
+        ponder = None
+
+        def callback(output):
+            nonlocal ponder
+            if output.startswith("bestmove"):
+                ponder = output.split()[3]
+                return True
+            return False
+
+        self.stockfish.check_output(callback)
+
+        other = "h8h7" if ponder == "h8g7" else "h8g7"
+
+        self.stockfish.send_command(f"{fen} moves a1a8 {ponder}")
+        self.stockfish.send_command("go ponder")
+        self.stockfish.send_command("stop")
+        self.stockfish.starts_with("bestmove")
+
+        self.stockfish.send_command(f"{fen} moves a1a8 {other}")
+        self.stockfish.send_command("go depth 5")
+        self.stockfish.contains("other pondered replies played 1 ")
+        self.stockfish.starts_with("bestmove")
+
+        self.stockfish.send_command("setoption name Ponder Candidates value 1")
+        self.stockfish.send_command(f"setoption name Threads value {get_threads()}")
+        self.stockfish.starts_with("info string Using")
+
 
 class TestSyzygy(metaclass=OrderedClassMembers):
     def beforeAll(self):
@@ -84,7 +84,31 @@ run_test "fen rr6/2kpp3/1ppnb1p1/p4q1p/P4P1P/1PNN2P1/2PP2Q1/1K2RR2 w E - 1 19" 4
 run_test "fen rr6/2kpp3/1ppnb1p1/p4q1p/P4P1P/1PNN2P1/2PP2Q1/1K2RR2 w E - 1 19" 5 79014522 "true"
 run_test "fen rr6/2kpp3/1ppnb1p1/p4q1p/P4P1P/1PNN2P1/2PP2Q1/1K2RR2 w E - 1 19" 6 2998685421 "true"
 
-rm -f $EXPECT_SCRIPT
+# perft suite from an EPD file, with one deliberately wrong count
+
+EPD_FILE=$(mktemp)
+
+cat << 'EOF' > $EPD_FILE
+rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 ;D1 20 ;D2 400 ;D3 8902 ;D4 197281
+r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - ;D1 48 ;D2 2039 ;D3 97862
+8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - ;D4 43238 ;D5 674624
+rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8 ;D3 62379 ;D4 2103488
+1rqbkrbn/1ppppp1p/1n6/p1N3p1/8/2P4P/PP1PPPP1/1RQBKRBN w FBfb - 0 9 ;D3 14569 ;D4 287739
+EOF
+
+echo -n "Testing perft suite... "
+SUITE_OUTPUT=$(printf "setoption name Threads value 2\nperftsuite $EPD_FILE\nquit\n" | ./stockfish)
+
+if echo "$SUITE_OUTPUT" | grep -q "Mismatches: 1" \
+   && echo "$SUITE_OUTPUT" | grep -q "Mismatch at depth 4: expected 2103488, counted 2103487"; then
+  echo "OK"
+else
+  echo "FAILED"
+  echo "$SUITE_OUTPUT"
+  TESTS_FAILED=1
+fi
+
+rm -f $EPD_FILE $EXPECT_SCRIPT
 echo "perft testing completed"
 
 if [ $TESTS_FAILED -ne 0 ]; then
@@ -12,15 +12,22 @@ echo "reprosearch testing started"
 
 # repeat two short games, separated by ucinewgame.
 # with go nodes $nodes they should result in exactly
-# the same node count for each iteration.
+# the same node count for each iteration, also with
+# several threads in deterministic mode. The hash is
+# large enough for "go" to arrive while the TT is
+# still being zeroed after ucinewgame.
 cat << EOF > repeat.exp
  set timeout 10
  spawn ./stockfish
- lassign \$argv nodes
+ lassign \$argv nodes threads
 
  send "uci\n"
  expect "uciok"
 
+ send "setoption name Threads value \$threads\n"
+ send "setoption name Deterministic SMP value true\n"
+ send "setoption name Hash value 1024\n"
+
  send "ucinewgame\n"
  send "position startpos\n"
  send "go nodes \$nodes\n"
@@ -45,16 +52,19 @@ EOF
 
 # to increase the likelihood of finding a non-reproducible case,
 # the allowed number of nodes are varied systematically
+for threads in 1 4
+do
 for i in `seq 1 20`
 do
 
   nodes=$((100*3**i/2**i))
-  echo "reprosearch testing with $nodes nodes"
+  echo "reprosearch testing with $nodes nodes and $threads threads"
 
   # each line should appear exactly an even number of times
-  expect repeat.exp $nodes 2>&1 | grep -o "nodes [0-9]*" | sort | uniq -c | awk '{if ($1%2!=0) exit(1)}'
+  expect repeat.exp $nodes $threads 2>&1 | grep -o "nodes [0-9]*" | sort | uniq -c | awk '{if ($1%2!=0) exit(1)}'
 
 done
+done
 
 rm repeat.exp
 